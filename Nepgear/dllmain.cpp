@@ -7,6 +7,7 @@
 #include "hooks/file_hook.h"
 #include "hooks/locale_emulator.h"
 #include "hooks/vfs.h"
+#include "hooks/trace.h"
 #include "hooks/crash_handler.h"
 #include "hooks/codepage_hook.h"
 #include "hooks/krkrz_hook.h"
@@ -50,6 +51,9 @@ BOOL APIENTRY DllMain(HMODULE hModule, DWORD ul_reason_for_call, LPVOID lpReserv
         Hooks::InstallRioShiinaHook();
         Utils::Log("[Core] All hooks installed.");
     }
+    else if (ul_reason_for_call == DLL_THREAD_DETACH) {
+        Trace::ThreadDetach();
+    }
     else if (ul_reason_for_call == DLL_PROCESS_DETACH) {
         Free();
         Utils::CleanupPatchFiles();
@@ -0,0 +1,247 @@
+#include "../pch.h"
+#include "cipher.h"
+#include <intrin.h>
+#include <immintrin.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+    const int kRounds = 8;
+    const ULONGLONG kKeyCheckCounter = ~0ULL; // derivation counts down from here; payloads never get close
+
+    typedef size_t (*XorBlocksFn)(const Cipher::Key& key, ULONGLONG counter, BYTE* data, size_t blocks);
+
+    struct Kernel {
+        XorBlocksFn xorBlocks;
+        const char* name;
+    };
+
+    // Original ChaCha layout: 64-bit block counter in words 12-13, the archive salt as nonce.
+    void InitState(const Cipher::Key& key, ULONGLONG counter, DWORD s[16]) {
+        s[0] = 0x61707865; s[1] = 0x3320646E; s[2] = 0x79622D32; s[3] = 0x6B206574;
+        memcpy(s + 4, key.words, sizeof(key.words));
+        s[12] = (DWORD)counter; s[13] = (DWORD)(counter >> 32);
+        s[14] = (DWORD)key.salt; s[15] = (DWORD)(key.salt >> 32);
+    }
+
+    inline void Quarter(DWORD& a, DWORD& b, DWORD& c, DWORD& d) {
+        a += b; d = _rotl(d ^ a, 16);
+        c += d; b = _rotl(b ^ c, 12);
+        a += b; d = _rotl(d ^ a, 8);
+        c += d; b = _rotl(b ^ c, 7);
+    }
+
+    void Block(const Cipher::Key& key, ULONGLONG counter, BYTE out[64]) {
+        DWORD s[16], x[16];
+        InitState(key, counter, s);
+        memcpy(x, s, sizeof(x));
+        for (int r = 0; r < kRounds; r += 2) {
+            Quarter(x[0], x[4], x[8], x[12]); Quarter(x[1], x[5], x[9], x[13]);
+            Quarter(x[2], x[6], x[10], x[14]); Quarter(x[3], x[7], x[11], x[15]);
+            Quarter(x[0], x[5], x[10], x[15]); Quarter(x[1], x[6], x[11], x[12]);
+            Quarter(x[2], x[7], x[8], x[13]); Quarter(x[3], x[4], x[9], x[14]);
+        }
+        for (int i = 0; i < 16; i++) x[i] += s[i];
+        memcpy(out, x, 64);
+    }
+
+    size_t XorBlocksScalar(const Cipher::Key& key, ULONGLONG counter, BYTE* data, size_t blocks) {
+        BYTE ks[64];
+        for (size_t i = 0; i < blocks; i++, data += 64) {
+            Block(key, counter + i, ks);
+            for (int j = 0; j < 64; j += 8) *(ULONGLONG*)(data + j) ^= *(const ULONGLONG*)(ks + j);
+        }
+        return blocks;
+    }
+
+    // The SIMD kernels run one block per lane: register i holds state word i of every block,
+    // and the words are transposed back into block order before the XOR.
+    template <int N> inline __m128i Rotl128(__m128i v) { return _mm_or_si128(_mm_slli_epi32(v, N), _mm_srli_epi32(v, 32 - N)); }
+
+    inline void Quarter128(__m128i& a, __m128i& b, __m128i& c, __m128i& d) {
+        a = _mm_add_epi32(a, b); d = Rotl128<16>(_mm_xor_si128(d, a));
+        c = _mm_add_epi32(c, d); b = Rotl128<12>(_mm_xor_si128(b, c));
+        a = _mm_add_epi32(a, b); d = Rotl128<8>(_mm_xor_si128(d, a));
+        c = _mm_add_epi32(c, d); b = Rotl128<7>(_mm_xor_si128(b, c));
+    }
+
+    size_t XorBlocksSSE2(const Cipher::Key& key, ULONGLONG counter, BYTE* data, size_t blocks) {
+        size_t done = 0;
+        for (; done + 4 <= blocks; done += 4, counter += 4) {
+            DWORD s[16];
+            InitState(key, counter, s);
+            __m128i in[16], x[16];
+            for (int i = 0; i < 16; i++) in[i] = _mm_set1_epi32((int)s[i]);
+            in[12] = _mm_setr_epi32((int)(DWORD)counter, (int)(DWORD)(counter + 1), (int)(DWORD)(counter + 2), (int)(DWORD)(counter + 3));
+            in[13] = _mm_setr_epi32((int)(DWORD)(counter >> 32), (int)(DWORD)((counter + 1) >> 32),
+                (int)(DWORD)((counter + 2) >> 32), (int)(DWORD)((counter + 3) >> 32));
+            for (int i = 0; i < 16; i++) x[i] = in[i];
+            for (int r = 0; r < kRounds; r += 2) {
+                Quarter128(x[0], x[4], x[8], x[12]); Quarter128(x[1], x[5], x[9], x[13]);
+                Quarter128(x[2], x[6], x[10], x[14]); Quarter128(x[3], x[7], x[11], x[15]);
+                Quarter128(x[0], x[5], x[10], x[15]); Quarter128(x[1], x[6], x[11], x[12]);
+                Quarter128(x[2], x[7], x[8], x[13]); Quarter128(x[3], x[4], x[9], x[14]);
+            }
+            BYTE* out = data + done * 64;
+            for (int g = 0; g < 4; g++) {
+                __m128i a = _mm_add_epi32(x[4 * g], in[4 * g]), b = _mm_add_epi32(x[4 * g + 1], in[4 * g + 1]);
+                __m128i c = _mm_add_epi32(x[4 * g + 2], in[4 * g + 2]), d = _mm_add_epi32(x[4 * g + 3], in[4 * g + 3]);
+                __m128i ab0 = _mm_unpacklo_epi32(a, b), ab1 = _mm_unpackhi_epi32(a, b);
+                __m128i cd0 = _mm_unpacklo_epi32(c, d), cd1 = _mm_unpackhi_epi32(c, d);
+                __m128i rows[4] = { _mm_unpacklo_epi64(ab0, cd0), _mm_unpackhi_epi64(ab0, cd0),
+                                    _mm_unpacklo_epi64(ab1, cd1), _mm_unpackhi_epi64(ab1, cd1) };
+                for (int k = 0; k < 4; k++) {
+                    __m128i* p = (__m128i*)(out + k * 64 + g * 16);
+                    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), rows[k]));
+                }
+            }
+        }
+        return done;
+    }
+
+    template <int N> inline __m256i Rotl256(__m256i v) { return _mm256_or_si256(_mm256_slli_epi32(v, N), _mm256_srli_epi32(v, 32 - N)); }
+
+    inline void Quarter256(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i rot16, __m256i rot8) {
+        a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot16);
+        c = _mm256_add_epi32(c, d); b = Rotl256<12>(_mm256_xor_si256(b, c));
+        a = _mm256_add_epi32(a, b); d = _mm256_shuffle_epi8(_mm256_xor_si256(d, a), rot8);
+        c = _mm256_add_epi32(c, d); b = Rotl256<7>(_mm256_xor_si256(b, c));
+    }
+
+    // Transposes four state words of eight blocks and XORs them into data. The unpacks work
+    // per 128-bit lane, so a row holds 16 bytes of block k in its low half and of block k + 4
+    // in its high half; pairing the rows of word groups g and g + 1 gives 32 contiguous bytes.
+    inline void Transpose4x8(__m256i a, __m256i b, __m256i c, __m256i d, __m256i rows[4]) {
+        __m256i ab0 = _mm256_unpacklo_epi32(a, b), ab1 = _mm256_unpackhi_epi32(a, b);
+        __m256i cd0 = _mm256_unpacklo_epi32(c, d), cd1 = _mm256_unpackhi_epi32(c, d);
+        rows[0] = _mm256_unpacklo_epi64(ab0, cd0); rows[1] = _mm256_unpackhi_epi64(ab0, cd0);
+        rows[2] = _mm256_unpacklo_epi64(ab1, cd1); rows[3] = _mm256_unpackhi_epi64(ab1, cd1);
+    }
+
+    inline void XorRows(const __m256i lo[4], const __m256i hi[4], BYTE* out) {
+        for (int k = 0; k < 4; k++) {
+            __m256i* p0 = (__m256i*)(out + k * 64);
+            __m256i* p1 = (__m256i*)(out + (k + 4) * 64);
+            _mm256_storeu_si256(p0, _mm256_xor_si256(_mm256_loadu_si256(p0), _mm256_permute2x128_si256(lo[k], hi[k], 0x20)));
+            _mm256_storeu_si256(p1, _mm256_xor_si256(_mm256_loadu_si256(p1), _mm256_permute2x128_si256(lo[k], hi[k], 0x31)));
+        }
+    }
+
+    // Eight blocks at a time, the state in sixteen locals so it stays in registers through the
+    // rounds. The input state is rebuilt from the key for the final add instead of kept alive,
+    // and the output is transposed half a block at a time.
+    size_t XorBlocksAVX2(const Cipher::Key& key, ULONGLONG counter, BYTE* data, size_t blocks) {
+        const __m256i rot16 = _mm256_setr_epi8(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13,
+                                               2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13);
+        const __m256i rot8 = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                              3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+        DWORD s[16];
+        InitState(key, 0, s);
+        auto Splat = [&s](int i) { return _mm256_set1_epi32((int)s[i]); };
+        size_t done = 0;
+        for (; done + 8 <= blocks; done += 8, counter += 8) {
+            DWORD lo[8], hi[8];
+            for (int i = 0; i < 8; i++) { lo[i] = (DWORD)(counter + i); hi[i] = (DWORD)((counter + i) >> 32); }
+            const __m256i ctrLo = _mm256_loadu_si256((const __m256i*)lo), ctrHi = _mm256_loadu_si256((const __m256i*)hi);
+            __m256i x0 = Splat(0), x1 = Splat(1), x2 = Splat(2), x3 = Splat(3);
+            __m256i x4 = Splat(4), x5 = Splat(5), x6 = Splat(6), x7 = Splat(7);
+            __m256i x8 = Splat(8), x9 = Splat(9), x10 = Splat(10), x11 = Splat(11);
+            __m256i x12 = ctrLo, x13 = ctrHi, x14 = Splat(14), x15 = Splat(15);
+            for (int r = 0; r < kRounds; r += 2) {
+                Quarter256(x0, x4, x8, x12, rot16, rot8); Quarter256(x1, x5, x9, x13, rot16, rot8);
+                Quarter256(x2, x6, x10, x14, rot16, rot8); Quarter256(x3, x7, x11, x15, rot16, rot8);
+                Quarter256(x0, x5, x10, x15, rot16, rot8); Quarter256(x1, x6, x11, x12, rot16, rot8);
+                Quarter256(x2, x7, x8, x13, rot16, rot8); Quarter256(x3, x4, x9, x14, rot16, rot8);
+            }
+            BYTE* out = data + done * 64;
+            __m256i rowsLo[4], rowsHi[4];
+            Transpose4x8(_mm256_add_epi32(x0, Splat(0)), _mm256_add_epi32(x1, Splat(1)),
+                         _mm256_add_epi32(x2, Splat(2)), _mm256_add_epi32(x3, Splat(3)), rowsLo);
+            Transpose4x8(_mm256_add_epi32(x4, Splat(4)), _mm256_add_epi32(x5, Splat(5)),
+                         _mm256_add_epi32(x6, Splat(6)), _mm256_add_epi32(x7, Splat(7)), rowsHi);
+            XorRows(rowsLo, rowsHi, out);
+            Transpose4x8(_mm256_add_epi32(x8, Splat(8)), _mm256_add_epi32(x9, Splat(9)),
+                         _mm256_add_epi32(x10, Splat(10)), _mm256_add_epi32(x11, Splat(11)), rowsLo);
+            Transpose4x8(_mm256_add_epi32(x12, ctrLo), _mm256_add_epi32(x13, ctrHi),
+                         _mm256_add_epi32(x14, Splat(14)), _mm256_add_epi32(x15, Splat(15)), rowsHi);
+            XorRows(rowsLo, rowsHi, out + 32);
+        }
+        return done;
+    }
+
+    bool CpuHasAVX2() {
+        int r[4];
+        __cpuid(r, 0);
+        if (r[0] < 7) return false;
+        __cpuid(r, 1);
+        bool osxsave = (r[2] & (1 << 27)) != 0, avx = (r[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return false;
+        __cpuidex(r, 7, 0);
+        return (r[1] & (1 << 5)) != 0;
+    }
+
+    Kernel SelectKernel() {
+        if (CpuHasAVX2()) return { XorBlocksAVX2, "AVX2" };
+#ifdef _WIN64
+        return { XorBlocksSSE2, "SSE2" };
+#else
+        if (IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE)) return { XorBlocksSSE2, "SSE2" };
+        return { XorBlocksScalar, "scalar" };
+#endif
+    }
+
+    const Kernel& ActiveKernel() {
+        static const Kernel kernel = SelectKernel();
+        return kernel;
+    }
+}
+
+namespace Cipher {
+    // Absorbs the passphrase 32 bytes at a time; each step replaces the key with the first
+    // half of a block under the previous key.
+    void DeriveKey(const char* passphrase, ULONGLONG salt, Key& key) {
+        memset(key.words, 0, sizeof(key.words));
+        key.salt = salt;
+        size_t len = strlen(passphrase);
+        BYTE block[64];
+        for (size_t pos = 0; pos == 0 || pos < len; pos += 32) {
+            DWORD chunk[8] = {};
+            memcpy(chunk, passphrase + pos, min(len - pos, sizeof(chunk)));
+            for (int i = 0; i < 8; i++) key.words[i] ^= chunk[i];
+            Block(key, kKeyCheckCounter - 1 - pos / 32, block);
+            memcpy(key.words, block, sizeof(key.words));
+        }
+    }
+
+    DWORD KeyCheck(const Key& key) {
+        BYTE block[64];
+        Block(key, kKeyCheckCounter, block);
+        DWORD check;
+        memcpy(&check, block, sizeof(check));
+        return check;
+    }
+
+    void Apply(const Key& key, ULONGLONG offset, BYTE* data, size_t size) {
+        ULONGLONG counter = offset / 64;
+        size_t skip = (size_t)(offset % 64);
+        BYTE ks[64];
+        if (skip && size) {
+            Block(key, counter++, ks);
+            size_t n = min(size, 64 - skip);
+            for (size_t i = 0; i < n; i++) data[i] ^= ks[skip + i];
+            data += n; size -= n;
+        }
+        size_t blocks = size / 64;
+        size_t done = ActiveKernel().xorBlocks(key, counter, data, blocks);
+        XorBlocksScalar(key, counter + done, data + done * 64, blocks - done);
+        data += blocks * 64; size -= blocks * 64;
+        if (size) {
+            Block(key, counter + blocks, ks);
+            for (size_t i = 0; i < size; i++) data[i] ^= ks[i];
+        }
+    }
+
+    const char* KernelName() {
+        return ActiveKernel().name;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <windows.h>
+
+// Optional keyed stream cipher over .chs entry payloads (ChaCha with 8 rounds). The keystream
+// is addressed by absolute archive offset, so any byte range decrypts on its own and readers
+// only XOR after they copy. It keeps generic unpackers out; the key ships in Nepgear.ini.
+// Built into both Nepgear and Packer.
+namespace Cipher {
+    const DWORD kArchiveMagic = 0x4543504E; // "NPCE"
+    const DWORD kArchiveVersion = 1;
+
+    // Precedes the entry count of an encrypted archive. Paths and sizes stay readable;
+    // every payload, chunk tables included, is encrypted.
+    struct ArchiveHeader {
+        DWORD magic;
+        DWORD version;
+        ULONGLONG salt;
+        DWORD keyCheck;
+        DWORD reserved;
+    };
+
+    struct Key {
+        DWORD words[8];
+        ULONGLONG salt;
+    };
+
+    // passphrase is UTF-8; the salt comes from the archive header.
+    void DeriveKey(const char* passphrase, ULONGLONG salt, Key& key);
+    // Stored in the header so a wrong ArchiveKey is reported instead of serving garbage.
+    DWORD KeyCheck(const Key& key);
+    // XORs the keystream for archive bytes [offset, offset + size) into data.
+    void Apply(const Key& key, ULONGLONG offset, BYTE* data, size_t size);
+    // "AVX2", "SSE2" or "scalar", whichever Apply uses on this CPU.
+    const char* KernelName();
+}
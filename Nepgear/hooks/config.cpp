@@ -39,7 +39,19 @@ namespace Config {
     wchar_t KrkrzPatchFile[MAX_PATH] = L"patch.xp3";
     char    RedirectFolderA[MAX_PATH] = "Nepgear";
     wchar_t ArchiveFileName[MAX_PATH] = L"Nepgear.chs";
+    wchar_t ArchiveKey[256] = L"";
     int     VFSMode = 0;
+    int     VFSDecodeCacheMB = 64;
+    bool    VFSPrefetch = true;
+    int     VFSExtractCacheMB = 2048;
+    int     VFSMemoryExtractMB = 256;
+    wchar_t VFSPreExtract[1024] = { 0 };
+    wchar_t VFSRealHandleFiles[1024] = { 0 };
+    int     VFSRealHandleMinKB = 32768;
+    bool    VFSLiveReload = false;
+    bool    VFSIndexSnapshot = true;
+    bool    VFSMetrics = false;
+    bool    VFSTrace = false;
     int     RioShiinaMode = 1;
     wchar_t RioShiinaArchivesToExtract[1024] = { 0 };
     bool    RioShiinaSkipInvalidFileName = true;
@@ -139,8 +151,25 @@ namespace Config {
         GetPrivateProfileStringW(L"FileRedirect", L"Folder", L"Nepgear", RedirectFolderW, MAX_PATH, ini);
         WCharToChar(RedirectFolderW, RedirectFolderA, MAX_PATH);
         GetPrivateProfileStringW(L"FileRedirect", L"ArchiveFile", L"Nepgear.chs", ArchiveFileName, MAX_PATH, ini);
+        GetPrivateProfileStringW(L"FileRedirect", L"ArchiveKey", L"", ArchiveKey, 256, ini);
 
         VFSMode = GetPrivateProfileIntW(L"FileHook", L"VFSMode", 0, ini);
+        VFSDecodeCacheMB = GetPrivateProfileIntW(L"FileHook", L"DecodeCacheMB", 64, ini);
+        if (VFSDecodeCacheMB < 0) VFSDecodeCacheMB = 0;
+        VFSPrefetch = GetPrivateProfileIntW(L"FileHook", L"Prefetch", 1, ini) != 0;
+        VFSExtractCacheMB = GetPrivateProfileIntW(L"FileHook", L"ExtractCacheMB", 2048, ini);
+        if (VFSExtractCacheMB < 0) VFSExtractCacheMB = 0;
+        VFSMemoryExtractMB = GetPrivateProfileIntW(L"FileHook", L"MemoryExtractMB", 256, ini);
+        if (VFSMemoryExtractMB < 0) VFSMemoryExtractMB = 0;
+        GetPrivateProfileStringW(L"FileHook", L"PreExtract", L"", VFSPreExtract, 1024, ini);
+        GetPrivateProfileStringW(L"FileHook", L"RealHandleFiles", L"*.dll|*.exe|*.asi|*.ax|*.mpg|*.mpeg|*.wmv|*.avi|*.mp4|*.webm|*.ogv|*.bik|*.usm",
+            VFSRealHandleFiles, 1024, ini);
+        VFSRealHandleMinKB = GetPrivateProfileIntW(L"FileHook", L"RealHandleMinKB", 32768, ini);
+        if (VFSRealHandleMinKB < 0) VFSRealHandleMinKB = 0;
+        VFSLiveReload = GetPrivateProfileIntW(L"FileHook", L"LiveReload", 0, ini) != 0;
+        VFSIndexSnapshot = GetPrivateProfileIntW(L"FileHook", L"IndexSnapshot", 1, ini) != 0;
+        VFSMetrics = GetPrivateProfileIntW(L"FileHook", L"Metrics", 0, ini) != 0;
+        VFSTrace = GetPrivateProfileIntW(L"FileHook", L"Trace", 0, ini) != 0;
 
         EnableKrkrzHook = GetPrivateProfileIntW(L"GLOBAL", L"EnableKrkrz", 0, ini) != 0;
         GetPrivateProfileStringW(L"GLOBAL", L"KrkrzPatchFile", L"patch.xp3", KrkrzPatchFile, MAX_PATH, ini);
@@ -38,7 +38,19 @@ namespace Config {
     extern wchar_t KrkrzPatchFile[MAX_PATH];
     extern char    RedirectFolderA[MAX_PATH];
     extern wchar_t ArchiveFileName[MAX_PATH];
+    extern wchar_t ArchiveKey[256];
     extern int     VFSMode;
+    extern int     VFSDecodeCacheMB;
+    extern bool    VFSPrefetch;
+    extern int     VFSExtractCacheMB;
+    extern int     VFSMemoryExtractMB;
+    extern wchar_t VFSPreExtract[1024];
+    extern wchar_t VFSRealHandleFiles[1024];
+    extern int     VFSRealHandleMinKB;
+    extern bool    VFSLiveReload;
+    extern bool    VFSIndexSnapshot;
+    extern bool    VFSMetrics;
+    extern bool    VFSTrace;
 
     extern int     RioShiinaMode;
     extern wchar_t RioShiinaArchivesToExtract[1024];
@@ -0,0 +1,219 @@
+#include "../pch.h"
+#include "extract_cache.h"
+#include "config.h"
+#include "utils.h"
+#include <shlwapi.h>
+#include <stdio.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+#pragma comment(lib, "Shlwapi.lib")
+
+namespace {
+    struct CacheRecord {
+        ULONGLONG size;
+        ULONGLONG lastUse;
+    };
+
+    std::unordered_map<ULONGLONG, CacheRecord> g_Records;
+    std::mutex g_CacheMutex;
+    wchar_t g_CacheDir[MAX_PATH] = { 0 };
+    ULONGLONG g_TotalBytes = 0;
+    ULONGLONG g_Budget = 0;
+    bool g_Ready = false;
+    bool g_Dirty = false;
+}
+
+static ULONGLONG Now() {
+    FILETIME ft; GetSystemTimeAsFileTime(&ft);
+    return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+static void EntryPath(ULONGLONG key, wchar_t* path) {
+    swprintf_s(path, MAX_PATH, L"%s\\%016llx.bin", g_CacheDir, key);
+}
+
+static void ManifestPath(wchar_t* path) {
+    swprintf_s(path, MAX_PATH, L"%s\\manifest.txt", g_CacheDir);
+}
+
+static void TouchRecord(ULONGLONG key, ULONGLONG size) {
+    auto it = g_Records.find(key);
+    if (it == g_Records.end()) {
+        g_Records[key] = { size, Now() };
+        g_TotalBytes += size;
+    } else {
+        it->second.lastUse = Now();
+    }
+    g_Dirty = true;
+}
+
+// The manifest only supplies last-use times; the entries themselves come from the cache
+// directory, so files committed after the last saved manifest (e.g. before a crash) still
+// count against the budget. Staging files left by an interrupted extraction are removed.
+static void LoadManifest() {
+    std::unordered_map<ULONGLONG, ULONGLONG> lastUses;
+    wchar_t path[MAX_PATH]; ManifestPath(path);
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, path, L"r") == 0 && fp) {
+        ULONGLONG key = 0, size = 0, lastUse = 0;
+        while (fscanf_s(fp, "%llx %llu %llu", &key, &size, &lastUse) == 3) lastUses[key] = lastUse;
+        fclose(fp);
+    }
+
+    wchar_t search[MAX_PATH];
+    swprintf_s(search, L"%s\\*", g_CacheDir);
+    WIN32_FIND_DATAW fd;
+    HANDLE hFind = FindFirstFileExW(search, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (hFind == INVALID_HANDLE_VALUE) return;
+    do {
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+        const wchar_t* ext = PathFindExtensionW(fd.cFileName);
+        if (_wcsicmp(ext, L".tmp") == 0) {
+            // Still open if another instance is extracting into it; then the delete just fails
+            wchar_t file[MAX_PATH];
+            swprintf_s(file, L"%s\\%s", g_CacheDir, fd.cFileName);
+            DeleteFileW(file);
+            continue;
+        }
+        wchar_t* end = nullptr;
+        ULONGLONG key = wcstoull(fd.cFileName, &end, 16);
+        if (_wcsicmp(ext, L".bin") != 0 || end != ext || g_Records.count(key)) continue;
+
+        ULONGLONG size = ((ULONGLONG)fd.nFileSizeHigh << 32) | fd.nFileSizeLow;
+        auto it = lastUses.find(key);
+        ULONGLONG lastUse = it != lastUses.end() ? it->second : ((ULONGLONG)fd.ftLastWriteTime.dwHighDateTime << 32) | fd.ftLastWriteTime.dwLowDateTime;
+        g_Records[key] = { size, lastUse };
+        g_TotalBytes += size;
+        if (it == lastUses.end()) g_Dirty = true;
+    } while (FindNextFileW(hFind, &fd));
+    FindClose(hFind);
+}
+
+static void SaveManifest() {
+    wchar_t path[MAX_PATH], tmp[MAX_PATH];
+    ManifestPath(path);
+    swprintf_s(tmp, L"%s.tmp", path);
+
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, tmp, L"w") != 0 || !fp) return;
+    for (const auto& kv : g_Records) {
+        fprintf(fp, "%016llx %llu %llu\n", kv.first, kv.second.size, kv.second.lastUse);
+    }
+    fclose(fp);
+    if (MoveFileExW(tmp, path, MOVEFILE_REPLACE_EXISTING)) g_Dirty = false;
+    else DeleteFileW(tmp);
+}
+
+static void EvictToFit(ULONGLONG incoming) {
+    if (g_TotalBytes + incoming <= g_Budget) return;
+
+    std::vector<std::pair<ULONGLONG, ULONGLONG>> byAge; // lastUse, key
+    byAge.reserve(g_Records.size());
+    for (const auto& kv : g_Records) byAge.push_back({ kv.second.lastUse, kv.first });
+    std::sort(byAge.begin(), byAge.end());
+
+    size_t evicted = 0;
+    for (const auto& victim : byAge) {
+        if (g_TotalBytes + incoming <= g_Budget) break;
+        wchar_t file[MAX_PATH]; EntryPath(victim.second, file);
+        // Files the game still has open can't be deleted; they stay until a later pass
+        if (!DeleteFileW(file) && GetLastError() != ERROR_FILE_NOT_FOUND) continue;
+        g_TotalBytes -= g_Records[victim.second].size;
+        g_Records.erase(victim.second);
+        evicted++;
+    }
+    if (evicted) {
+        g_Dirty = true;
+        if (Config::EnableDebug) Utils::Log("[VFS-Extract] Evicted %zu cached files (%llu MB in use)", evicted, g_TotalBytes / (1024 * 1024));
+    }
+}
+
+// Removes files left by the old offset-named cache layout in the shared root.
+static void RemoveLegacyFiles(const wchar_t* rootDir) {
+    wchar_t search[MAX_PATH];
+    swprintf_s(search, L"%s\\vfs_*.tmp", rootDir);
+    WIN32_FIND_DATAW fd;
+    HANDLE hFind = FindFirstFileW(search, &fd);
+    if (hFind == INVALID_HANDLE_VALUE) return;
+    do {
+        wchar_t file[MAX_PATH];
+        swprintf_s(file, L"%s\\%s", rootDir, fd.cFileName);
+        DeleteFileW(file);
+    } while (FindNextFileW(hFind, &fd));
+    FindClose(hFind);
+}
+
+namespace ExtractCache {
+    bool Initialize(const wchar_t* rootDir) {
+        std::lock_guard<std::mutex> lock(g_CacheMutex);
+        if (g_Ready) return true;
+        if (!rootDir || !PathIsDirectoryW(rootDir)) return false;
+        RemoveLegacyFiles(rootDir);
+
+        // One directory per game, keyed by the executable path
+        wchar_t exePath[MAX_PATH];
+        GetModuleFileNameW(NULL, exePath, MAX_PATH);
+        CharLowerW(exePath);
+        ULONGLONG gameId = Utils::HashBytes(exePath, wcslen(exePath) * sizeof(wchar_t));
+        swprintf_s(g_CacheDir, L"%s\\%016llx", rootDir, gameId);
+        if (!PathIsDirectoryW(g_CacheDir) && !CreateDirectoryW(g_CacheDir, NULL)) return false;
+
+        g_Budget = (ULONGLONG)Config::VFSExtractCacheMB * 1024 * 1024;
+        LoadManifest();
+        g_Ready = true;
+        Utils::LogW(L"[VFS-Extract] Cache %s: %zu files, %llu MB (limit %d MB)",
+            g_CacheDir, g_Records.size(), g_TotalBytes / (1024 * 1024), Config::VFSExtractCacheMB);
+        return true;
+    }
+
+    void Shutdown() {
+        std::lock_guard<std::mutex> lock(g_CacheMutex);
+        if (!g_Ready) return;
+        EvictToFit(0);
+        if (g_Dirty) SaveManifest();
+        g_Records.clear();
+        g_TotalBytes = 0;
+        g_Ready = false;
+    }
+
+    bool IsReady() { return g_Ready; }
+
+    bool Lookup(ULONGLONG key, wchar_t* path) {
+        std::lock_guard<std::mutex> lock(g_CacheMutex);
+        if (!g_Ready) return false;
+        EntryPath(key, path);
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExW(path, GetFileExInfoStandard, &data)) return false;
+        TouchRecord(key, ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow);
+        return true;
+    }
+
+    void GetStagingPath(ULONGLONG key, wchar_t* path) {
+        swprintf_s(path, MAX_PATH, L"%s\\%016llx.%lu.tmp", g_CacheDir, key, GetCurrentThreadId());
+    }
+
+    void GetMemoryPath(ULONGLONG key, DWORD sequence, wchar_t* path) {
+        swprintf_s(path, MAX_PATH, L"%s\\%016llx.%lu.%lu.mem", g_CacheDir, key, GetCurrentProcessId(), sequence);
+    }
+
+    bool Commit(ULONGLONG key, const wchar_t* stagingPath, wchar_t* path) {
+        std::lock_guard<std::mutex> lock(g_CacheMutex);
+        if (!g_Ready) return false;
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExW(stagingPath, GetFileExInfoStandard, &data)) return false;
+        ULONGLONG size = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+
+        EvictToFit(size);
+        EntryPath(key, path);
+        if (!MoveFileExW(stagingPath, path, MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFileW(stagingPath);
+            // Another thread may have committed the same entry first
+            if (!PathFileExistsW(path)) return false;
+        }
+        TouchRecord(key, size);
+        return true;
+    }
+}
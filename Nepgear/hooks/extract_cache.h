@@ -0,0 +1,23 @@
+#pragma once
+#include <windows.h>
+
+// Persistent on-disk cache of entries extracted for Modern VFS mode.
+// Files live in a per-game directory, are named by a key derived from the archive
+// identity and the entry, and are written via temp file + rename so a half-written
+// file is never served. A manifest tracks last use for LRU eviction; sizes are taken
+// from the directory itself at startup.
+namespace ExtractCache {
+    bool Initialize(const wchar_t* rootDir);
+    void Shutdown();
+    bool IsReady();
+
+    // Fills path with the cached file for key and returns true if it is present.
+    bool Lookup(ULONGLONG key, wchar_t* path);
+    // Temp file in the cache directory to extract into before Commit.
+    void GetStagingPath(ULONGLONG key, wchar_t* path);
+    // Name for a delete-on-close memory file of this process; it is never committed.
+    // sequence keeps names unique, since an evicted file stays delete-pending while open.
+    void GetMemoryPath(ULONGLONG key, DWORD sequence, wchar_t* path);
+    // Moves a fully written staging file into place, evicting old entries to fit the budget.
+    bool Commit(ULONGLONG key, const wchar_t* stagingPath, wchar_t* path);
+}
@@ -1,5 +1,6 @@
 #include "../pch.h"
 #include <windows.h>
+#include <winternl.h>
 #include <stdio.h>
 #include <shlwapi.h>
 #include <string>
@@ -10,6 +11,7 @@ namespace fs = std::filesystem;
 #include "utils.h"
 #include "../detours.h"
 #include "vfs.h"
+#include "path_canon.h"
 #include "rioshiina_hook.h"
 
 #ifdef _WIN64
@@ -38,6 +40,13 @@ typedef BOOL(WINAPI* pFindNextFileW)(HANDLE, LPWIN32_FIND_DATAW);
 typedef HANDLE(WINAPI* pFindFirstFileA)(LPCSTR, LPWIN32_FIND_DATAA);
 typedef BOOL(WINAPI* pFindNextFileA)(HANDLE, LPWIN32_FIND_DATAA);
 typedef BOOL(WINAPI* pFindClose)(HANDLE);
+typedef HANDLE(WINAPI* pCreateFileMappingA)(HANDLE, LPSECURITY_ATTRIBUTES, DWORD, DWORD, DWORD, LPCSTR);
+typedef HANDLE(WINAPI* pCreateFileMappingW)(HANDLE, LPSECURITY_ATTRIBUTES, DWORD, DWORD, DWORD, LPCWSTR);
+typedef NTSTATUS(NTAPI* pNtMapViewOfSection)(HANDLE, HANDLE, PVOID*, ULONG_PTR, SIZE_T, PLARGE_INTEGER, PSIZE_T, DWORD, ULONG, ULONG);
+typedef NTSTATUS(NTAPI* pNtMapViewOfSectionEx)(HANDLE, HANDLE, PVOID*, PLARGE_INTEGER, PSIZE_T, ULONG, ULONG, PVOID, ULONG);
+typedef BOOL(WINAPI* pReadFileEx)(HANDLE, LPVOID, DWORD, LPOVERLAPPED, LPOVERLAPPED_COMPLETION_ROUTINE);
+typedef BOOL(WINAPI* pGetFileInformationByHandleEx)(HANDLE, FILE_INFO_BY_HANDLE_CLASS, LPVOID, DWORD);
+typedef DWORD(WINAPI* pGetFinalPathNameByHandleW)(HANDLE, LPWSTR, DWORD, DWORD);
 
 static pCreateFileA orgCreateFileA = CreateFileA;
 static pCreateFileW orgCreateFileW = CreateFileW;
@@ -58,6 +67,13 @@ static pFindNextFileW orgFindNextFileW = FindNextFileW;
 static pFindFirstFileA orgFindFirstFileA = FindFirstFileA;
 static pFindNextFileA orgFindNextFileA = FindNextFileA;
 static pFindClose orgFindClose = FindClose;
+static pCreateFileMappingA orgCreateFileMappingA = CreateFileMappingA;
+static pCreateFileMappingW orgCreateFileMappingW = CreateFileMappingW;
+static pNtMapViewOfSection orgNtMapViewOfSection = nullptr;
+static pNtMapViewOfSectionEx orgNtMapViewOfSectionEx = nullptr; // Windows 10 1803 and later
+static pReadFileEx orgReadFileEx = ReadFileEx;
+static pGetFileInformationByHandleEx orgGetFileInformationByHandleEx = GetFileInformationByHandleEx;
+static pGetFinalPathNameByHandleW orgGetFinalPathNameByHandleW = GetFinalPathNameByHandleW;
 
 static char g_GameRootA[MAX_PATH] = { 0 };
 static wchar_t g_GameRootW[MAX_PATH] = { 0 };
@@ -65,6 +81,44 @@ static size_t g_GameRootLenA = 0;
 static size_t g_GameRootLenW = 0;
 static bool g_Initialized = false;
 
+// Head of RTL_USER_PROCESS_PARAMETERS up to the current directory, which winternl.h
+// only declares as reserved space.
+struct ProcessParametersHead {
+    BYTE Reserved1[16];
+    PVOID Reserved2[5]; // console handle and flags, standard handles
+    UNICODE_STRING CurrentDirectory;
+};
+
+// Per-thread copy of the current directory, so relative paths can be resolved without
+// GetFullPathName or a shared lock. Every use compares it against the directory in the
+// PEB, which catches changes made by any API (kernelbase, RtlSetCurrentDirectory_U,
+// _wchdir). A read racing a change at worst refreshes once more than needed.
+namespace {
+    struct CurrentDirectoryCache {
+        wchar_t peb[MAX_PATH]; // as stored in the PEB, with a trailing backslash
+        USHORT pebBytes;
+        char dirA[MAX_PATH];
+        wchar_t dirW[MAX_PATH];
+    };
+    __declspec(thread) CurrentDirectoryCache t_CurrentDir;
+}
+
+static const CurrentDirectoryCache& CurrentDirectory() {
+    CurrentDirectoryCache& c = t_CurrentDir;
+    const UNICODE_STRING& dos = ((ProcessParametersHead*)NtCurrentTeb()->ProcessEnvironmentBlock->ProcessParameters)->CurrentDirectory;
+    USHORT bytes = dos.Length;
+    if (bytes != 0 && bytes == c.pebBytes && memcmp(dos.Buffer, c.peb, bytes) == 0) return c;
+
+    if (bytes >= sizeof(c.peb)) bytes = 0;
+    memcpy(c.peb, dos.Buffer, bytes);
+    c.pebBytes = bytes;
+    DWORD lenA = GetCurrentDirectoryA(MAX_PATH, c.dirA);
+    if (lenA == 0 || lenA >= MAX_PATH) c.dirA[0] = '\0';
+    DWORD lenW = GetCurrentDirectoryW(MAX_PATH, c.dirW);
+    if (lenW == 0 || lenW >= MAX_PATH) c.dirW[0] = L'\0';
+    return c;
+}
+
 void InitPaths() {
     if (g_Initialized) return;
     if (GetModuleFileNameA(NULL, g_GameRootA, MAX_PATH)) {
@@ -85,7 +139,8 @@ void InitPaths() {
 bool GetRelativePathA(LPCSTR inPath, char* outRelPath) {
     if (!inPath) return false;
     char fullAbsPath[MAX_PATH];
-    if (GetFullPathNameA(inPath, MAX_PATH, fullAbsPath, NULL) == 0) return false;
+    bool resolved = CanonicalizePath(inPath, CurrentDirectory().dirA, fullAbsPath);
+    if (!resolved && GetFullPathNameA(inPath, MAX_PATH, fullAbsPath, NULL) == 0) return false;
     if (_strnicmp(fullAbsPath, g_GameRootA, g_GameRootLenA) == 0) {
         strcpy_s(outRelPath, MAX_PATH, fullAbsPath + g_GameRootLenA);
         return true;
@@ -96,7 +151,7 @@ bool GetRelativePathA(LPCSTR inPath, char* outRelPath) {
 bool GetRelativePathW(LPCWSTR inPath, wchar_t* outRelPath) {
     if (!inPath) return false;
     wchar_t fullAbsPath[MAX_PATH];
-    if (GetFullPathNameW(inPath, MAX_PATH, fullAbsPath, NULL) == 0) return false;
+    if (!Hooks::GetFullPathW(inPath, fullAbsPath)) return false;
     if (_wcsnicmp(fullAbsPath, g_GameRootW, g_GameRootLenW) == 0) {
         wcscpy_s(outRelPath, MAX_PATH, fullAbsPath + g_GameRootLenW);
         return true;
@@ -110,20 +165,20 @@ static inline bool IsVirtualHandleRange(HANDLE h) {
 }
 
 HANDLE WINAPI newCreateFileA(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile) {
-    if (!Config::EnableFileHook || !VFS::IsActive()) {
+    if (!Config::EnableFileHook || !VFS::MayBeVirtualA(lpFileName)) {
         return orgCreateFileA(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
     }
     __try {
-        InitPaths();
-        char relPath[MAX_PATH];
-        if (GetRelativePathA(lpFileName, relPath)) {
-            if (VFS::HasVirtualFileA(relPath)) {
-                HANDLE vHandle = VFS::OpenVirtualFileA(relPath);
-                if (vHandle != INVALID_HANDLE_VALUE) {
-                    if (Config::EnableDebug) Utils::Log("[VFS-FileA] %s -> handle %p", lpFileName, vHandle);
-                    return vHandle;
-                }
-            }
+        HANDLE vHandle = VFS::OpenCachedVirtualFile();
+        if (vHandle == INVALID_HANDLE_VALUE) {
+            InitPaths();
+            char relPath[MAX_PATH];
+            if (GetRelativePathA(lpFileName, relPath)) vHandle = VFS::OpenVirtualFileA(relPath);
+            else VFS::NoteNotVirtualA(lpFileName);
+        }
+        if (vHandle != INVALID_HANDLE_VALUE) {
+            if (Config::EnableDebug) Utils::Log("[VFS-FileA] %s -> handle %p", lpFileName, vHandle);
+            return vHandle;
         }
     }
     __except(EXCEPTION_EXECUTE_HANDLER) {
@@ -133,20 +188,20 @@ HANDLE WINAPI newCreateFileA(LPCSTR lpFileName, DWORD dwDesiredAccess, DWORD dwS
 }
 
 HANDLE WINAPI newCreateFileW(LPCWSTR lpFileName, DWORD dwDesiredAccess, DWORD dwShareMode, LPSECURITY_ATTRIBUTES lpSecurityAttributes, DWORD dwCreationDisposition, DWORD dwFlagsAndAttributes, HANDLE hTemplateFile) {
-    if (!Config::EnableFileHook || !VFS::IsActive()) {
+    if (!Config::EnableFileHook || !VFS::MayBeVirtual(lpFileName)) {
         return orgCreateFileW(lpFileName, dwDesiredAccess, dwShareMode, lpSecurityAttributes, dwCreationDisposition, dwFlagsAndAttributes, hTemplateFile);
     }
     __try {
-        InitPaths();
-        wchar_t relPath[MAX_PATH];
-        if (GetRelativePathW(lpFileName, relPath)) {
-            if (VFS::HasVirtualFile(relPath)) {
-                HANDLE vHandle = VFS::OpenVirtualFile(relPath);
-                if (vHandle != INVALID_HANDLE_VALUE) {
-                    if (Config::EnableDebug) Utils::Log("[VFS-FileW] %S -> handle %p", lpFileName, vHandle);
-                    return vHandle;
-                }
-            }
+        HANDLE vHandle = VFS::OpenCachedVirtualFile();
+        if (vHandle == INVALID_HANDLE_VALUE) {
+            InitPaths();
+            wchar_t relPath[MAX_PATH];
+            if (GetRelativePathW(lpFileName, relPath)) vHandle = VFS::OpenVirtualFile(relPath);
+            else VFS::NoteNotVirtual(lpFileName);
+        }
+        if (vHandle != INVALID_HANDLE_VALUE) {
+            if (Config::EnableDebug) Utils::Log("[VFS-FileW] %S -> handle %p", lpFileName, vHandle);
+            return vHandle;
         }
     }
     __except(EXCEPTION_EXECUTE_HANDLER) {
@@ -224,6 +279,7 @@ BOOL WINAPI newCloseHandle(HANDLE hObject) {
     __except(EXCEPTION_EXECUTE_HANDLER) {
         Utils::Log("[VFS] Exception in newCloseHandle for handle %p", hObject);
     }
+    VFS::ReleaseVirtualMapping(hObject);
     return orgCloseHandle(hObject);
 }
 
@@ -251,100 +307,150 @@ DWORD WINAPI newGetFileType(HANDLE hFile) {
     return orgGetFileType(hFile);
 }
 
+HANDLE WINAPI newCreateFileMappingW(HANDLE hFile, LPSECURITY_ATTRIBUTES lpAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR lpName) {
+    __try {
+        if (IsVirtualHandleRange(hFile) && VFS::IsVirtualHandle(hFile)) {
+            return VFS::CreateVirtualFileMapping(hFile, lpAttributes, flProtect, dwMaximumSizeHigh, dwMaximumSizeLow, lpName);
+        }
+    }
+    __except(EXCEPTION_EXECUTE_HANDLER) {
+        Utils::Log("[VFS] Exception in newCreateFileMappingW for handle %p", hFile);
+    }
+    return orgCreateFileMappingW(hFile, lpAttributes, flProtect, dwMaximumSizeHigh, dwMaximumSizeLow, lpName);
+}
+
+HANDLE WINAPI newCreateFileMappingA(HANDLE hFile, LPSECURITY_ATTRIBUTES lpAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCSTR lpName) {
+    __try {
+        if (IsVirtualHandleRange(hFile) && VFS::IsVirtualHandle(hFile)) {
+            wchar_t name[MAX_PATH];
+            if (lpName && !MultiByteToWideChar(Config::LE_Codepage, 0, lpName, -1, name, MAX_PATH)) lpName = nullptr;
+            return VFS::CreateVirtualFileMapping(hFile, lpAttributes, flProtect, dwMaximumSizeHigh, dwMaximumSizeLow, lpName ? name : nullptr);
+        }
+    }
+    __except(EXCEPTION_EXECUTE_HANDLER) {
+        Utils::Log("[VFS] Exception in newCreateFileMappingA for handle %p", hFile);
+    }
+    return orgCreateFileMappingA(hFile, lpAttributes, flProtect, dwMaximumSizeHigh, dwMaximumSizeLow, lpName);
+}
+
+// Direct mappings are duplicates of the archive section. MapViewOfFile, MapViewOfFileEx,
+// MapViewOfFile3 and MapViewOfFileFromApp all end up in NtMapViewOfSection(Ex), so views
+// are moved to the entry's place in the archive there, and the offset reported back is
+// made relative to the entry again.
+const NTSTATUS kStatusInvalidViewSize = (NTSTATUS)0xC000001FL;
+
+template <typename MapFn>
+static NTSTATUS MapSectionView(HANDLE hSection, PLARGE_INTEGER sectionOffset, PSIZE_T viewSize, MapFn map) {
+    LONGLONG offset = 0, entryOffset = 0;
+    SIZE_T size = 0;
+    bool direct = false, outOfRange = false;
+    __try {
+        offset = sectionOffset ? sectionOffset->QuadPart : 0;
+        size = viewSize ? *viewSize : 0;
+        direct = viewSize && VFS::TranslateDirectView(hSection, offset, size, entryOffset, outOfRange);
+    }
+    __except(EXCEPTION_EXECUTE_HANDLER) {
+        Utils::Log("[VFS] Exception in NtMapViewOfSection for section %p", hSection);
+    }
+    if (!direct) return map(sectionOffset, viewSize);
+    if (outOfRange) return kStatusInvalidViewSize;
+    LARGE_INTEGER moved; moved.QuadPart = offset;
+    NTSTATUS status = map(&moved, &size);
+    if (status >= 0) {
+        if (sectionOffset) sectionOffset->QuadPart = moved.QuadPart - entryOffset;
+        *viewSize = size;
+    }
+    return status;
+}
+
+NTSTATUS NTAPI newNtMapViewOfSection(HANDLE SectionHandle, HANDLE ProcessHandle, PVOID* BaseAddress, ULONG_PTR ZeroBits, SIZE_T CommitSize, PLARGE_INTEGER SectionOffset, PSIZE_T ViewSize, DWORD InheritDisposition, ULONG AllocationType, ULONG Win32Protect) {
+    return MapSectionView(SectionHandle, SectionOffset, ViewSize, [&](PLARGE_INTEGER offset, PSIZE_T size) {
+        return orgNtMapViewOfSection(SectionHandle, ProcessHandle, BaseAddress, ZeroBits, CommitSize, offset, size, InheritDisposition, AllocationType, Win32Protect);
+    });
+}
+
+NTSTATUS NTAPI newNtMapViewOfSectionEx(HANDLE SectionHandle, HANDLE ProcessHandle, PVOID* BaseAddress, PLARGE_INTEGER SectionOffset, PSIZE_T ViewSize, ULONG AllocationType, ULONG PageProtection, PVOID ExtendedParameters, ULONG ExtendedParameterCount) {
+    return MapSectionView(SectionHandle, SectionOffset, ViewSize, [&](PLARGE_INTEGER offset, PSIZE_T size) {
+        return orgNtMapViewOfSectionEx(SectionHandle, ProcessHandle, BaseAddress, offset, size, AllocationType, PageProtection, ExtendedParameters, ExtendedParameterCount);
+    });
+}
+
+static void FillAttributeData(const VFS::VirtualFileInfo& info, WIN32_FILE_ATTRIBUTE_DATA* data) {
+    ZeroMemory(data, sizeof(WIN32_FILE_ATTRIBUTE_DATA));
+    data->dwFileAttributes = info.attributes;
+    data->ftCreationTime = info.creationTime;
+    data->ftLastAccessTime = info.lastAccessTime;
+    data->ftLastWriteTime = info.lastWriteTime;
+    data->nFileSizeLow = (DWORD)(info.size & 0xFFFFFFFF);
+    data->nFileSizeHigh = (DWORD)(info.size >> 32);
+}
+
 DWORD WINAPI newGetFileAttributesA(LPCSTR lpFileName) {
-    if (!Config::EnableFileHook || !VFS::IsActive()) {
+    if (!Config::EnableFileHook || !VFS::MayBeVirtualA(lpFileName)) {
         return orgGetFileAttributesA(lpFileName);
     }
     InitPaths();
     char relPath[MAX_PATH];
-    if (GetRelativePathA(lpFileName, relPath)) {
-        if (VFS::HasVirtualFileA(relPath)) {
-            if (Config::EnableDebug) Utils::Log("[VFS-AttribA] %s exists", lpFileName);
-            return FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_READONLY;
-        }
+    VFS::VirtualFileInfo info;
+    if (VFS::GetCachedVirtualFileInfo(&info) || (GetRelativePathA(lpFileName, relPath) && VFS::GetVirtualFileInfoA(relPath, &info))) {
+        if (Config::EnableDebug) Utils::Log("[VFS-AttribA] %s exists", lpFileName);
+        return info.attributes;
     }
+    VFS::NoteNotVirtualA(lpFileName);
     return orgGetFileAttributesA(lpFileName);
 }
 
 DWORD WINAPI newGetFileAttributesW(LPCWSTR lpFileName) {
-    if (!Config::EnableFileHook || !VFS::IsActive()) {
+    if (!Config::EnableFileHook || !VFS::MayBeVirtual(lpFileName)) {
         return orgGetFileAttributesW(lpFileName);
     }
     InitPaths();
     wchar_t relPath[MAX_PATH];
-    if (GetRelativePathW(lpFileName, relPath)) {
-        if (VFS::HasVirtualFile(relPath)) {
-            if (Config::EnableDebug) Utils::Log("[VFS-AttribW] %S exists", lpFileName);
-            return FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_READONLY;
-        }
+    VFS::VirtualFileInfo info;
+    if (VFS::GetCachedVirtualFileInfo(&info) || (GetRelativePathW(lpFileName, relPath) && VFS::GetVirtualFileInfo(relPath, &info))) {
+        if (Config::EnableDebug) Utils::Log("[VFS-AttribW] %S exists", lpFileName);
+        return info.attributes;
     }
+    VFS::NoteNotVirtual(lpFileName);
     return orgGetFileAttributesW(lpFileName);
 }
 
 BOOL WINAPI newGetFileAttributesExA(LPCSTR lpFileName, GET_FILEEX_INFO_LEVELS fInfoLevelId, LPVOID lpFileInformation) {
-    if (!Config::EnableFileHook || !VFS::IsActive()) {
+    if (!Config::EnableFileHook || !VFS::MayBeVirtualA(lpFileName)) {
         return orgGetFileAttributesExA(lpFileName, fInfoLevelId, lpFileInformation);
     }
     InitPaths();
     char relPath[MAX_PATH];
-    if (GetRelativePathA(lpFileName, relPath)) {
-        if (VFS::HasVirtualFileA(relPath)) {
-            HANDLE vHandle = VFS::OpenVirtualFileA(relPath);
-            if (vHandle != INVALID_HANDLE_VALUE) {
-                if (fInfoLevelId == GetFileExInfoStandard && lpFileInformation) {
-                    WIN32_FILE_ATTRIBUTE_DATA* data = (WIN32_FILE_ATTRIBUTE_DATA*)lpFileInformation;
-                    ZeroMemory(data, sizeof(WIN32_FILE_ATTRIBUTE_DATA));
-                    data->dwFileAttributes = FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_READONLY;
-                    DWORD sizeHigh = 0;
-                    if (IsVirtualHandleRange(vHandle)) {
-                        data->nFileSizeLow = VFS::GetVirtualFileSize(vHandle, &sizeHigh);
-                        VFS::CloseVirtualHandle(vHandle);
-                    } else {
-                        data->nFileSizeLow = GetFileSize(vHandle, &sizeHigh);
-                        CloseHandle(vHandle);
-                    }
-                    data->nFileSizeHigh = sizeHigh;
-                }
-                return TRUE;
-            }
+    VFS::VirtualFileInfo info;
+    if (VFS::GetCachedVirtualFileInfo(&info) || (GetRelativePathA(lpFileName, relPath) && VFS::GetVirtualFileInfoA(relPath, &info))) {
+        if (fInfoLevelId == GetFileExInfoStandard && lpFileInformation) {
+            FillAttributeData(info, (WIN32_FILE_ATTRIBUTE_DATA*)lpFileInformation);
         }
+        return TRUE;
     }
+    VFS::NoteNotVirtualA(lpFileName);
     return orgGetFileAttributesExA(lpFileName, fInfoLevelId, lpFileInformation);
 }
 
 BOOL WINAPI newGetFileAttributesExW(LPCWSTR lpFileName, GET_FILEEX_INFO_LEVELS fInfoLevelId, LPVOID lpFileInformation) {
-    if (!Config::EnableFileHook || !VFS::IsActive()) {
+    if (!Config::EnableFileHook || !VFS::MayBeVirtual(lpFileName)) {
         return orgGetFileAttributesExW(lpFileName, fInfoLevelId, lpFileInformation);
     }
     InitPaths();
     wchar_t relPath[MAX_PATH];
-    if (GetRelativePathW(lpFileName, relPath)) {
-        if (VFS::HasVirtualFile(relPath)) {
-            HANDLE vHandle = VFS::OpenVirtualFile(relPath);
-            if (vHandle != INVALID_HANDLE_VALUE) {
-                if (fInfoLevelId == GetFileExInfoStandard && lpFileInformation) {
-                    WIN32_FILE_ATTRIBUTE_DATA* data = (WIN32_FILE_ATTRIBUTE_DATA*)lpFileInformation;
-                    ZeroMemory(data, sizeof(WIN32_FILE_ATTRIBUTE_DATA));
-                    data->dwFileAttributes = FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_READONLY;
-                    DWORD sizeHigh = 0;
-                    if (IsVirtualHandleRange(vHandle)) {
-                        data->nFileSizeLow = VFS::GetVirtualFileSize(vHandle, &sizeHigh);
-                        VFS::CloseVirtualHandle(vHandle);
-                    } else {
-                        data->nFileSizeLow = GetFileSize(vHandle, &sizeHigh);
-                        CloseHandle(vHandle);
-                    }
-                    data->nFileSizeHigh = sizeHigh;
-                }
-                return TRUE;
-            }
+    VFS::VirtualFileInfo info;
+    if (VFS::GetCachedVirtualFileInfo(&info) || (GetRelativePathW(lpFileName, relPath) && VFS::GetVirtualFileInfo(relPath, &info))) {
+        if (fInfoLevelId == GetFileExInfoStandard && lpFileInformation) {
+            FillAttributeData(info, (WIN32_FILE_ATTRIBUTE_DATA*)lpFileInformation);
         }
+        return TRUE;
     }
+    VFS::NoteNotVirtual(lpFileName);
     return orgGetFileAttributesExW(lpFileName, fInfoLevelId, lpFileInformation);
 }
 
 HANDLE WINAPI newFindFirstFileW(LPCWSTR lpFileName, LPWIN32_FIND_DATAW lpFindFileData) {
-    if (!Config::EnableFileHook || !VFS::IsActive()) {
+    if (!Config::EnableFileHook || !VFS::MayContainVirtual(lpFileName)) {
         return orgFindFirstFileW(lpFileName, lpFindFileData);
     }
     return VFS::VirtualFindFirstFileW(lpFileName, lpFindFileData);
@@ -358,7 +464,7 @@ BOOL WINAPI newFindNextFileW(HANDLE hFindFile, LPWIN32_FIND_DATAW lpFindFileData
 }
 
 HANDLE WINAPI newFindFirstFileA(LPCSTR lpFileName, LPWIN32_FIND_DATAA lpFindFileData) {
-    if (!Config::EnableFileHook || !VFS::IsActive()) {
+    if (!Config::EnableFileHook || !VFS::MayContainVirtualA(lpFileName)) {
         return orgFindFirstFileA(lpFileName, lpFindFileData);
     }
     return VFS::VirtualFindFirstFileA(lpFileName, lpFindFileData);
@@ -378,7 +484,39 @@ BOOL WINAPI newFindClose(HANDLE hFindFile) {
     return orgFindClose(hFindFile);
 }
 
+// Observers for APIs the VFS does not emulate, attached in automatic mode only. Emulated
+// handles still fail there; the VFS learns to serve that entry with a real handle.
+static void NoteUnhookedUse(HANDLE hFile, const char* api) {
+    __try {
+        if (IsVirtualHandleRange(hFile)) VFS::NoteUnhookedUse(hFile, api);
+    }
+    __except(EXCEPTION_EXECUTE_HANDLER) {
+        Utils::Log("[VFS] Exception in %s observer for handle %p", api, hFile);
+    }
+}
+
+BOOL WINAPI newReadFileEx(HANDLE hFile, LPVOID lpBuffer, DWORD nNumberOfBytesToRead, LPOVERLAPPED lpOverlapped, LPOVERLAPPED_COMPLETION_ROUTINE lpCompletionRoutine) {
+    NoteUnhookedUse(hFile, "ReadFileEx");
+    return orgReadFileEx(hFile, lpBuffer, nNumberOfBytesToRead, lpOverlapped, lpCompletionRoutine);
+}
+
+BOOL WINAPI newGetFileInformationByHandleEx(HANDLE hFile, FILE_INFO_BY_HANDLE_CLASS FileInformationClass, LPVOID lpFileInformation, DWORD dwBufferSize) {
+    NoteUnhookedUse(hFile, "GetFileInformationByHandleEx");
+    return orgGetFileInformationByHandleEx(hFile, FileInformationClass, lpFileInformation, dwBufferSize);
+}
+
+DWORD WINAPI newGetFinalPathNameByHandleW(HANDLE hFile, LPWSTR lpszFilePath, DWORD cchFilePath, DWORD dwFlags) {
+    NoteUnhookedUse(hFile, "GetFinalPathNameByHandleW");
+    return orgGetFinalPathNameByHandleW(hFile, lpszFilePath, cchFilePath, dwFlags);
+}
+
 namespace Hooks {
+    bool GetFullPathW(LPCWSTR inPath, wchar_t* outPath) {
+        if (CanonicalizePath(inPath, CurrentDirectory().dirW, outPath)) return true;
+        DWORD len = GetFullPathNameW(inPath, MAX_PATH, outPath, NULL);
+        return len != 0 && len < MAX_PATH;
+    }
+
     void InstallFileHook() {
         if (!Config::EnableFileHook) return;
         InitPaths();
@@ -403,6 +541,18 @@ namespace Hooks {
         DetourAttach(&(PVOID&)orgFindFirstFileA, newFindFirstFileA);
         DetourAttach(&(PVOID&)orgFindNextFileA, newFindNextFileA);
         DetourAttach(&(PVOID&)orgFindClose, newFindClose);
+        DetourAttach(&(PVOID&)orgCreateFileMappingA, newCreateFileMappingA);
+        DetourAttach(&(PVOID&)orgCreateFileMappingW, newCreateFileMappingW);
+        HMODULE ntdll = GetModuleHandleW(L"ntdll.dll");
+        orgNtMapViewOfSection = (pNtMapViewOfSection)GetProcAddress(ntdll, "NtMapViewOfSection");
+        orgNtMapViewOfSectionEx = (pNtMapViewOfSectionEx)GetProcAddress(ntdll, "NtMapViewOfSectionEx");
+        if (orgNtMapViewOfSection) DetourAttach(&(PVOID&)orgNtMapViewOfSection, newNtMapViewOfSection);
+        if (orgNtMapViewOfSectionEx) DetourAttach(&(PVOID&)orgNtMapViewOfSectionEx, newNtMapViewOfSectionEx);
+        if (Config::VFSMode == 2) {
+            DetourAttach(&(PVOID&)orgReadFileEx, newReadFileEx);
+            DetourAttach(&(PVOID&)orgGetFileInformationByHandleEx, newGetFileInformationByHandleEx);
+            DetourAttach(&(PVOID&)orgGetFinalPathNameByHandleW, newGetFinalPathNameByHandleW);
+        }
         DetourTransactionCommit();
         VFS::SetOriginalFunctions((void*)orgReadFile, (void*)orgSetFilePointerEx, (void*)orgCloseHandle);
         VFS::SetFindFunctions((void*)orgFindFirstFileW, (void*)orgFindNextFileW, (void*)orgFindClose, (void*)orgFindFirstFileA, (void*)orgFindNextFileA);
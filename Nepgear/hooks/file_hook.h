@@ -1,5 +1,9 @@
 ﻿#pragma once
 
+#include <windows.h>
+
 namespace Hooks {
     void InstallFileHook();
+    // Absolute form of inPath against the game's current directory (MAX_PATH buffer).
+    bool GetFullPathW(LPCWSTR inPath, wchar_t* outPath);
 }
@@ -0,0 +1,216 @@
+#include "../pch.h"
+#include "loose_scan.h"
+#include "utils.h"
+#include <stdio.h>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <unordered_set>
+#include <algorithm>
+
+namespace {
+    const DWORD kManifestMagic = 0x534C504E; // "NPLS"
+    const DWORD kManifestVersion = 2;
+    const DWORD kMaxScanThreads = 8;
+
+    struct ScannedFile {
+        std::wstring name;
+        DWORD size;
+        FILETIME lastWriteTime;
+    };
+
+    struct ScannedDir {
+        std::wstring relativePath; // "" for the root
+        ULONGLONG lastWriteTime;
+        std::vector<ScannedFile> files;
+        std::vector<std::wstring> subdirs;
+    };
+
+    // Shared by the calling thread and the workers. The caller takes part in the scan
+    // and only waits for directories another thread has already claimed, so the scan
+    // still completes when workers cannot start yet (e.g. under the loader lock).
+    struct ScanContext {
+        std::wstring root;
+        std::unordered_set<std::wstring> queued; // every directory ever pushed to pending
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<std::wstring> pending;
+        size_t active;
+        std::vector<ScannedDir> results;
+        size_t known; // directories queued up front from the manifest
+
+        ScanContext() : active(0), known(0) {}
+    };
+
+    struct ManifestReader {
+        const BYTE* p;
+        const BYTE* end;
+        bool ok;
+
+        bool Take(void* dst, size_t n) {
+            if (!ok || (size_t)(end - p) < n) return ok = false;
+            memcpy(dst, p, n); p += n;
+            return true;
+        }
+        DWORD U32() { DWORD v = 0; Take(&v, sizeof(v)); return v; }
+        std::wstring String() {
+            DWORD len = U32();
+            if (!ok || (size_t)(end - p) < (size_t)len * sizeof(wchar_t)) { ok = false; return L""; }
+            std::wstring s((const wchar_t*)p, len); p += (size_t)len * sizeof(wchar_t);
+            return s;
+        }
+    };
+}
+
+static ULONGLONG ToULL(const FILETIME& ft) {
+    return ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+}
+
+static std::wstring JoinPath(const std::wstring& base, const std::wstring& name) {
+    return base.empty() ? name : base + L"\\" + name;
+}
+
+static void PutU32(std::vector<BYTE>& b, DWORD v) { b.insert(b.end(), (const BYTE*)&v, (const BYTE*)&v + sizeof(v)); }
+static void PutString(std::vector<BYTE>& b, const std::wstring& s) {
+    PutU32(b, (DWORD)s.length());
+    b.insert(b.end(), (const BYTE*)s.c_str(), (const BYTE*)(s.c_str() + s.length()));
+}
+
+// The manifest only records which directories exist. Queueing all of them at once lets
+// every thread start listing straight away instead of waiting for parents to be walked;
+// file sizes and times always come from the listing itself, since editing a file in place
+// leaves its directory's write time alone.
+static bool LoadManifest(const wchar_t* path, std::vector<std::wstring>& dirs) {
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, path, L"rb") != 0 || !fp) return false;
+    std::vector<BYTE> data;
+    BYTE block[65536];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), fp)) > 0) data.insert(data.end(), block, block + n);
+    fclose(fp);
+
+    ManifestReader r = { data.data(), data.data() + data.size(), true };
+    if (r.U32() != kManifestMagic || r.U32() != kManifestVersion) return false;
+    DWORD dirCount = r.U32();
+    for (DWORD i = 0; i < dirCount && r.ok; i++) dirs.push_back(r.String());
+    if (!r.ok) dirs.clear();
+    return r.ok;
+}
+
+static void SaveManifest(const wchar_t* path, const std::vector<ScannedDir>& dirs) {
+    std::vector<BYTE> data;
+    PutU32(data, kManifestMagic);
+    PutU32(data, kManifestVersion);
+    PutU32(data, (DWORD)dirs.size());
+    for (const auto& dir : dirs) PutString(data, dir.relativePath);
+
+    wchar_t tmp[MAX_PATH];
+    swprintf_s(tmp, L"%s.tmp", path);
+    FILE* fp = nullptr;
+    if (_wfopen_s(&fp, tmp, L"wb") != 0 || !fp) return;
+    bool written = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    fclose(fp);
+    if (!written || !MoveFileExW(tmp, path, MOVEFILE_REPLACE_EXISTING)) DeleteFileW(tmp);
+}
+
+// Lists one directory. Returns false if it no longer exists (a manifest entry that was
+// removed or renamed since the last run).
+static bool ScanDirectory(ScanContext& ctx, const std::wstring& rel, ScannedDir& dir) {
+    std::wstring full = JoinPath(ctx.root, rel);
+    dir.relativePath = rel;
+    dir.lastWriteTime = 0;
+
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesExW(full.c_str(), GetFileExInfoStandard, &attr) || !(attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) return false;
+    dir.lastWriteTime = ToULL(attr.ftLastWriteTime);
+
+    WIN32_FIND_DATAW fd;
+    HANDLE hFind = FindFirstFileExW((full + L"\\*").c_str(), FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+    if (hFind == INVALID_HANDLE_VALUE) return false;
+    do {
+        if (wcscmp(fd.cFileName, L".") == 0 || wcscmp(fd.cFileName, L"..") == 0) continue;
+        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) dir.subdirs.push_back(fd.cFileName);
+        else dir.files.push_back({ fd.cFileName, fd.nFileSizeLow, fd.ftLastWriteTime });
+    } while (FindNextFileW(hFind, &fd));
+    FindClose(hFind);
+    return true;
+}
+
+static void RunScan(ScanContext& ctx) {
+    std::unique_lock<std::mutex> lock(ctx.mutex);
+    for (;;) {
+        ctx.changed.wait(lock, [&] { return !ctx.pending.empty() || ctx.active == 0; });
+        if (ctx.pending.empty()) return;
+        std::wstring rel = std::move(ctx.pending.front());
+        ctx.pending.pop_front();
+        ctx.active++;
+        lock.unlock();
+
+        ScannedDir dir;
+        bool exists = ScanDirectory(ctx, rel, dir);
+
+        lock.lock();
+        if (exists) {
+            for (const auto& sub : dir.subdirs) {
+                std::wstring child = JoinPath(rel, sub);
+                if (ctx.queued.insert(child).second) ctx.pending.push_back(std::move(child));
+            }
+            ctx.results.push_back(std::move(dir));
+        }
+        ctx.active--;
+        ctx.changed.notify_all();
+    }
+}
+
+static __declspec(thread) bool t_ScanThread = false;
+
+static DWORD WINAPI ScanWorker(LPVOID param) {
+    t_ScanThread = true;
+    std::unique_ptr<std::shared_ptr<ScanContext>> holder((std::shared_ptr<ScanContext>*)param);
+    RunScan(**holder);
+    return 0;
+}
+
+namespace LooseScan {
+    bool IsScanThread() { return t_ScanThread; }
+
+    void Scan(const wchar_t* root, const wchar_t* manifestPath, std::vector<LooseFile>& files, std::vector<LooseDirectory>* dirs) {
+        ULONGLONG start = GetTickCount64();
+        auto ctx = std::make_shared<ScanContext>();
+        ctx->root = root;
+        std::vector<std::wstring> previous;
+        if (manifestPath) LoadManifest(manifestPath, previous);
+        ctx->queued.insert(L"");
+        ctx->pending.push_back(L"");
+        for (const auto& rel : previous) {
+            if (ctx->queued.insert(rel).second) ctx->pending.push_back(rel);
+        }
+        ctx->known = previous.size();
+
+        SYSTEM_INFO si; GetSystemInfo(&si);
+        DWORD threads = min(si.dwNumberOfProcessors, kMaxScanThreads);
+        for (DWORD i = 1; i < threads; i++) {
+            auto* param = new std::shared_ptr<ScanContext>(ctx);
+            HANDLE hThread = CreateThread(NULL, 0, ScanWorker, param, 0, NULL);
+            if (hThread) CloseHandle(hThread);
+            else delete param;
+        }
+        RunScan(*ctx);
+
+        std::lock_guard<std::mutex> lock(ctx->mutex);
+        std::sort(ctx->results.begin(), ctx->results.end(),
+            [](const ScannedDir& a, const ScannedDir& b) { return a.relativePath < b.relativePath; });
+        for (const auto& dir : ctx->results) {
+            if (dirs) dirs->push_back({ dir.relativePath, dir.lastWriteTime });
+            for (const auto& f : dir.files) files.push_back({ JoinPath(dir.relativePath, f.name), f.size, f.lastWriteTime });
+        }
+        // Both lists are sorted and include the root, so any added or removed directory shows up here.
+        bool changed = ctx->results.size() != previous.size();
+        for (size_t i = 0; !changed && i < previous.size(); i++) changed = ctx->results[i].relativePath != previous[i];
+        if (manifestPath && changed) SaveManifest(manifestPath, ctx->results);
+
+        Utils::Log("[VFS] Loose folder: %zu files in %zu directories (%zu queued from manifest) in %llu ms",
+            files.size(), ctx->results.size(), ctx->known, GetTickCount64() - start);
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+
+// Startup scan of the loose redirect folder. Directories are enumerated on worker
+// threads with large-fetch FindFirstFileEx. A manifest of the directories seen on the
+// previous run queues them all up front; file attributes are always listed fresh.
+namespace LooseScan {
+    struct LooseFile {
+        std::wstring relativePath;
+        DWORD size;
+        FILETIME lastWriteTime;
+    };
+
+    struct LooseDirectory {
+        std::wstring relativePath; // "" for the root
+        ULONGLONG lastWriteTime;
+    };
+
+    // Fills files with every file under root (paths relative to root, directories in
+    // sorted order). manifestPath may be null to disable the manifest; dirs, if given,
+    // receives every directory visited with its write time.
+    void Scan(const wchar_t* root, const wchar_t* manifestPath, std::vector<LooseFile>& files, std::vector<LooseDirectory>* dirs = nullptr);
+    // True on the scan's worker threads, which the VFS must not block while it is initializing.
+    bool IsScanThread();
+}
@@ -0,0 +1,179 @@
+#include "../pch.h"
+#include "metrics.h"
+#include "config.h"
+#include "utils.h"
+#include <shlwapi.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#pragma comment(lib, "Shlwapi.lib")
+
+namespace {
+    const DWORD kPageRows = 4096;
+    const DWORD kMaxPages = 4096; // 16M rows, far beyond any archive
+    const size_t kTopEntries = 20;
+
+    const char* const kCounterNames[Metrics::COUNTER_COUNT] = {
+        "opens", "reads", "bytes_served", "decodes", "decode_us", "extractions", "extract_us", "cache_hits", "cache_misses"
+    };
+
+    struct EntryCounters {
+        volatile LONGLONG values[Metrics::COUNTER_COUNT];
+    };
+
+    EntryCounters* volatile g_Pages[kMaxPages] = { 0 };
+    volatile LONGLONG g_Totals[Metrics::COUNTER_COUNT] = { 0 };
+    ULONGLONG g_IndexBuildMs = 0;
+    bool g_IndexFromSnapshot = false;
+    size_t g_IndexEntries = 0;
+    LARGE_INTEGER g_Frequency = { 0 };
+    ULONGLONG g_StartUs = 0;
+    bool g_Enabled = false;
+    wchar_t g_OutputPath[MAX_PATH] = { 0 };
+
+    void (*g_DumpRequested)() = nullptr;
+    HANDLE g_DumpEvent = NULL;
+    HANDLE g_StopEvent = NULL;
+    HANDLE g_DumpThread = NULL;
+}
+
+static void AppendJsonString(std::string& out, const wchar_t* s) {
+    char utf8[MAX_PATH * 3];
+    int len = WideCharToMultiByte(CP_UTF8, 0, s, -1, utf8, sizeof(utf8), NULL, NULL);
+    out += '"';
+    for (int i = 0; i + 1 < len; i++) {
+        char c = utf8[i];
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if ((unsigned char)c < 0x20) { char esc[8]; sprintf_s(esc, "\\u%04x", c); out += esc; }
+        else out += c;
+    }
+    out += '"';
+}
+
+static void AppendCounters(std::string& out, const volatile LONGLONG* values) {
+    char buf[64];
+    for (int i = 0; i < Metrics::COUNTER_COUNT; i++) {
+        sprintf_s(buf, "%s\"%s\": %lld", i ? ", " : "", kCounterNames[i], values[i]);
+        out += buf;
+    }
+}
+
+static ULONGLONG EntryCost(const EntryCounters& e) {
+    return (ULONGLONG)(e.values[Metrics::DECODE_US] + e.values[Metrics::EXTRACT_US]);
+}
+
+static DWORD WINAPI DumpWorker(LPVOID) {
+    HANDLE events[2] = { g_StopEvent, g_DumpEvent };
+    while (WaitForMultipleObjects(2, events, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+        if (g_DumpRequested) g_DumpRequested();
+    }
+    return 0;
+}
+
+namespace Metrics {
+    void Initialize(void (*dumpRequested)()) {
+        g_Enabled = Config::VFSMetrics;
+        if (!g_Enabled) return;
+        QueryPerformanceFrequency(&g_Frequency);
+        g_StartUs = Now();
+        GetModuleFileNameW(NULL, g_OutputPath, MAX_PATH);
+        PathRemoveFileSpecW(g_OutputPath);
+        PathAppendW(g_OutputPath, L"Nepgear_metrics.json");
+
+        wchar_t eventName[64];
+        swprintf_s(eventName, L"Local\\NepgearVFSMetrics_%lu", GetCurrentProcessId());
+        g_DumpRequested = dumpRequested;
+        g_DumpEvent = CreateEventW(NULL, FALSE, FALSE, eventName);
+        g_StopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (g_DumpEvent && g_StopEvent) g_DumpThread = CreateThread(NULL, 0, DumpWorker, NULL, 0, NULL);
+        Utils::LogW(L"[VFS-Metrics] Enabled, signal %s to write %s", eventName, g_OutputPath);
+    }
+
+    // Called from DLL_PROCESS_DETACH, so the watcher is signalled but never waited on.
+    void Shutdown() {
+        if (g_StopEvent) SetEvent(g_StopEvent);
+        if (g_DumpThread) { CloseHandle(g_DumpThread); g_DumpThread = NULL; }
+        g_DumpRequested = nullptr;
+        g_Enabled = false;
+    }
+
+    bool IsEnabled() { return g_Enabled; }
+
+    ULONGLONG Now() {
+        if (!g_Enabled) return 0;
+        LARGE_INTEGER t; QueryPerformanceCounter(&t);
+        return (ULONGLONG)(t.QuadPart / g_Frequency.QuadPart * 1000000 + t.QuadPart % g_Frequency.QuadPart * 1000000 / g_Frequency.QuadPart);
+    }
+
+    void Add(DWORD row, Counter counter, ULONGLONG value) {
+        if (!g_Enabled) return;
+        InterlockedExchangeAdd64(&g_Totals[counter], (LONGLONG)value);
+        if (row == MAXDWORD || row / kPageRows >= kMaxPages) return;
+        EntryCounters* page = g_Pages[row / kPageRows];
+        if (!page) {
+            EntryCounters* fresh = new EntryCounters[kPageRows]();
+            page = (EntryCounters*)InterlockedCompareExchangePointer((PVOID volatile*)&g_Pages[row / kPageRows], fresh, nullptr);
+            if (page) delete[] fresh;
+            else page = fresh;
+        }
+        InterlockedExchangeAdd64(&page[row % kPageRows].values[counter], (LONGLONG)value);
+    }
+
+    void SetIndexBuild(ULONGLONG milliseconds, bool fromSnapshot, size_t entries) {
+        g_IndexBuildMs = milliseconds; g_IndexFromSnapshot = fromSnapshot; g_IndexEntries = entries;
+    }
+
+    void WriteJson(const char* reason, PathSnapshot snapshot) {
+        if (!g_Enabled) return;
+        std::vector<std::pair<DWORD, const EntryCounters*>> touched;
+        for (DWORD p = 0; p < kMaxPages; p++) {
+            const EntryCounters* page = g_Pages[p];
+            if (!page) continue;
+            for (DWORD i = 0; i < kPageRows; i++) {
+                const EntryCounters& e = page[i];
+                if (e.values[OPENS] || e.values[READS] || e.values[DECODES] || e.values[EXTRACTIONS]) touched.push_back({ p * kPageRows + i, &e });
+            }
+        }
+        std::sort(touched.begin(), touched.end(), [](const std::pair<DWORD, const EntryCounters*>& a, const std::pair<DWORD, const EntryCounters*>& b) {
+            ULONGLONG ca = EntryCost(*a.second), cb = EntryCost(*b.second);
+            return ca != cb ? ca > cb : a.second->values[BYTES_SERVED] > b.second->values[BYTES_SERVED];
+        });
+        std::vector<DWORD> rows;
+        rows.reserve(touched.size());
+        for (const auto& t : touched) rows.push_back(t.first);
+        std::vector<std::wstring> paths;
+        if (snapshot) snapshot(rows, paths);
+        paths.resize(rows.size());
+
+        LONGLONG hits = g_Totals[CACHE_HITS], misses = g_Totals[CACHE_MISSES];
+        char buf[256];
+        std::string out = "{\n";
+        sprintf_s(buf, "  \"reason\": \"%s\",\n  \"uptime_ms\": %llu,\n", reason, (Now() - g_StartUs) / 1000); out += buf;
+        sprintf_s(buf, "  \"index\": {\"build_ms\": %llu, \"from_snapshot\": %s, \"entries\": %zu},\n",
+            g_IndexBuildMs, g_IndexFromSnapshot ? "true" : "false", g_IndexEntries); out += buf;
+        out += "  \"totals\": {"; AppendCounters(out, g_Totals);
+        sprintf_s(buf, ", \"cache_hit_ratio\": %.4f},\n", hits + misses ? (double)hits / (hits + misses) : 0.0); out += buf;
+
+        for (int section = 0; section < 2; section++) {
+            size_t count = section == 0 ? min(touched.size(), kTopEntries) : touched.size();
+            out += section == 0 ? "  \"most_expensive\": [" : "  \"entries\": [";
+            for (size_t i = 0; i < count; i++) {
+                out += i ? ",\n    {\"path\": " : "\n    {\"path\": ";
+                AppendJsonString(out, paths[i].c_str());
+                out += ", ";
+                AppendCounters(out, touched[i].second->values);
+                out += "}";
+            }
+            out += section == 0 ? "\n  ],\n" : "\n  ]\n";
+        }
+        out += "}\n";
+
+        FILE* fp = nullptr;
+        if (_wfopen_s(&fp, g_OutputPath, L"wb") != 0 || !fp) return;
+        fwrite(out.data(), 1, out.size(), fp);
+        fclose(fp);
+        Utils::Log("[VFS-Metrics] Wrote %zu entries (%s)", touched.size(), reason);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+
+// Optional VFS counters for diagnosing slow loading. Totals and per-entry counters are
+// interlocked adds into preallocated pages; everything is written as JSON next to the
+// game executable on shutdown or whenever the dump event is signalled.
+namespace Metrics {
+    enum Counter {
+        OPENS,
+        READS,
+        BYTES_SERVED,
+        DECODES,
+        DECODE_US,
+        EXTRACTIONS,
+        EXTRACT_US,
+        CACHE_HITS,
+        CACHE_MISSES,
+        COUNTER_COUNT
+    };
+
+    // Copies the path of every row into paths, in the same order. Only this runs under the
+    // caller's lock; WriteJson formats and writes the file after it returns.
+    typedef void (*PathSnapshot)(const std::vector<DWORD>& rows, std::vector<std::wstring>& paths);
+
+    // dumpRequested runs on the watcher thread when Local\NepgearVFSMetrics_<pid> is signalled.
+    void Initialize(void (*dumpRequested)());
+    void Shutdown();
+    bool IsEnabled();
+
+    // Microsecond timestamp for timing decodes and extractions; 0 when disabled.
+    ULONGLONG Now();
+    // row may be MAXDWORD to update only the totals.
+    void Add(DWORD row, Counter counter, ULONGLONG value = 1);
+    void SetIndexBuild(ULONGLONG milliseconds, bool fromSnapshot, size_t entries);
+
+    void WriteJson(const char* reason, PathSnapshot snapshot);
+}
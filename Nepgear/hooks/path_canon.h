@@ -0,0 +1,58 @@
+#pragma once
+#include <windows.h>
+
+// Pure path arithmetic shared by the file hooks and the portable tests (no Win32 calls).
+template <typename C> inline bool IsPathSeparator(C c) { return c == '\\' || c == '/'; }
+
+// Resolves inPath to an absolute path the way GetFullPathName does for the common cases:
+// drive-absolute, rooted and cwd-relative paths with '/', '.', '..' and repeated separators.
+// Returns false for anything it does not model (UNC and device paths, drive-relative
+// "X:foo", stream names, components ending in '.' or ' ') so the caller can fall back.
+// Narrow paths with non-ASCII bytes also fall back: a DBCS trail byte can be 0x5C.
+template <typename C> bool CanonicalizePath(const C* inPath, const C* cwd, C* out) {
+    if (sizeof(C) == 1) {
+        for (const C* p = inPath; *p; p++) if ((unsigned char)*p >= 0x80) return false;
+        for (const C* p = cwd; *p; p++) if ((unsigned char)*p >= 0x80) return false;
+    }
+    size_t len = 0;
+    const C* rest = inPath;
+    if (inPath[0] && inPath[1] == ':') {
+        if (!IsPathSeparator(inPath[2])) return false;
+        out[len++] = inPath[0]; out[len++] = ':';
+        rest = inPath + 2;
+    } else {
+        if (IsPathSeparator(inPath[0]) && IsPathSeparator(inPath[1])) return false;
+        if (!cwd[0] || cwd[1] != ':') return false;
+        if (IsPathSeparator(inPath[0])) { out[len++] = cwd[0]; out[len++] = ':'; }
+        else {
+            while (cwd[len]) {
+                if (len + 1 >= MAX_PATH) return false;
+                out[len] = cwd[len]; len++;
+            }
+            while (len > 2 && IsPathSeparator(out[len - 1])) len--;
+        }
+    }
+
+    for (const C* p = rest; *p;) {
+        while (IsPathSeparator(*p)) p++;
+        const C* begin = p;
+        while (*p && !IsPathSeparator(*p)) {
+            if (*p == ':') return false;
+            p++;
+        }
+        size_t n = p - begin;
+        if (n == 0 || (n == 1 && begin[0] == '.')) continue;
+        if (n == 2 && begin[0] == '.' && begin[1] == '.') {
+            while (len > 2 && !IsPathSeparator(out[len - 1])) len--;
+            if (len > 2) len--;
+            continue;
+        }
+        if (begin[n - 1] == '.' || begin[n - 1] == ' ') return false;
+        if (len + 1 + n >= MAX_PATH) return false;
+        out[len++] = '\\';
+        for (size_t i = 0; i < n; i++) out[len++] = begin[i];
+    }
+    if (len == 2) out[len++] = '\\';
+    out[len] = 0;
+    return true;
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include <windows.h>
+#include <vector>
+#include "path_key.h"
+
+// Folded FNV-1a of one path component; narrow callers only pass ASCII.
+template <typename C> ULONGLONG HashComponent(const C* begin, const C* end) {
+    ULONGLONG h = 14695981039346656037ULL;
+    for (const C* p = begin; p != end; ++p) {
+        h ^= (ULONGLONG)FoldPathChar((wchar_t)*p);
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// Bloom filter over folded path components (file and directory names), so the hooks can
+// turn away non-virtual paths before resolving them. MayContain needs no lock: bits are
+// only ever set, so names are added in place while other threads test.
+class PathFilter {
+public:
+    static const DWORD kProbes = 4;
+    static const DWORD kBitsPerName = 16;
+
+    PathFilter() : m_Mask(0) {}
+
+    // Sized for names at build time; names added later only raise the false positive rate.
+    void Reset(size_t names) {
+        ULONGLONG bits = 1 << 16;
+        while (bits < (ULONGLONG)names * kBitsPerName) bits <<= 1;
+        m_Bits.assign((size_t)(bits / 64), 0);
+        m_Mask = bits - 1;
+    }
+
+    void Clear() {
+        m_Mask = 0; // readers check the mask first
+        m_Bits.clear();
+    }
+
+    void AddName(ULONGLONG h) {
+        ULONGLONG step = (h >> 32) | 1;
+        for (DWORD i = 0; i < kProbes; i++) {
+            ULONGLONG bit = (h + i * step) & m_Mask;
+            m_Bits[(size_t)(bit >> 6)] |= 1ULL << (bit & 63);
+        }
+    }
+
+    // Adds every component of a relative index path.
+    void AddPath(const wchar_t* path) {
+        if (!m_Mask) return;
+        const wchar_t* begin = path;
+        for (const wchar_t* p = path;; ++p) {
+            if (*p == L'\\' || *p == L'/' || *p == L'\0') {
+                if (p != begin) AddName(HashComponent(begin, p));
+                if (!*p) break;
+                begin = p + 1;
+            }
+        }
+    }
+
+    bool TestName(ULONGLONG h) const {
+        ULONGLONG step = (h >> 32) | 1;
+        for (DWORD i = 0; i < kProbes; i++) {
+            ULONGLONG bit = (h + i * step) & m_Mask;
+            if (!(m_Bits[(size_t)(bit >> 6)] & (1ULL << (bit & 63)))) return false;
+        }
+        return true;
+    }
+
+    // Returns false only when the last component of path (or of its directory, for a search
+    // pattern) is certainly not in the filter. Trailing dots and spaces are dropped the way
+    // Win32 path resolution does; narrow names with non-ASCII bytes are always let through
+    // because their wide form depends on the codepage.
+    template <typename C> bool MayContain(const C* path, bool directoryOnly) const {
+        if (!m_Mask) return true;
+        const C* end = path;
+        while (*end) end++;
+        auto isSeparator = [](C c) { return c == '\\' || c == '/' || c == ':'; };
+        if (directoryOnly) {
+            while (end > path && !isSeparator(end[-1])) end--;
+            if (end == path) return true; // pattern in the current directory
+            end--;
+        }
+        while (end > path && (end[-1] == '.' || end[-1] == ' ')) end--;
+        const C* begin = end;
+        while (begin > path && !isSeparator(begin[-1])) begin--;
+        if (begin == end) return true;
+        for (const C* p = begin; p != end; ++p) {
+            if (sizeof(C) == 1 && (unsigned char)*p >= 0x80) return true;
+        }
+        return TestName(HashComponent(begin, end));
+    }
+
+private:
+    std::vector<ULONGLONG> m_Bits;
+    ULONGLONG m_Mask; // bit count - 1, 0 while there is no filter
+};
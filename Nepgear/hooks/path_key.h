@@ -0,0 +1,43 @@
+#pragma once
+#include <windows.h>
+#include <string>
+
+// Index keys are stored normalized (no leading separators, '/' -> '\\', ASCII lower case).
+// PathHash/PathEqual apply the same folding on the fly, so lookups can take the
+// caller's raw buffer without building a normalized std::wstring first.
+inline wchar_t FoldPathChar(wchar_t c) {
+    if (c == L'/') return L'\\';
+    if (c >= L'A' && c <= L'Z') return c + (L'a' - L'A');
+    return c;
+}
+
+inline const wchar_t* SkipLeadingSeparators(const wchar_t* p) {
+    while (*p == L'\\' || *p == L'/') p++;
+    return p;
+}
+
+struct PathHash {
+    using is_transparent = void;
+    size_t operator()(const std::wstring& s) const { return Hash(s.c_str()); }
+    size_t operator()(const wchar_t* s) const { return Hash(s); }
+    static size_t Hash(const wchar_t* p) {
+        size_t h = (size_t)14695981039346656037ULL;
+        for (p = SkipLeadingSeparators(p); *p; ++p) {
+            h ^= (size_t)FoldPathChar(*p);
+            h *= (size_t)1099511628211ULL;
+        }
+        return h;
+    }
+};
+
+struct PathEqual {
+    using is_transparent = void;
+    bool operator()(const std::wstring& a, const std::wstring& b) const { return Equal(a.c_str(), b.c_str()); }
+    bool operator()(const wchar_t* a, const std::wstring& b) const { return Equal(a, b.c_str()); }
+    bool operator()(const std::wstring& a, const wchar_t* b) const { return Equal(a.c_str(), b); }
+    static bool Equal(const wchar_t* a, const wchar_t* b) {
+        a = SkipLeadingSeparators(a); b = SkipLeadingSeparators(b);
+        while (*a && FoldPathChar(*a) == FoldPathChar(*b)) { ++a; ++b; }
+        return FoldPathChar(*a) == FoldPathChar(*b);
+    }
+};
@@ -0,0 +1,51 @@
+#pragma once
+#include <windows.h>
+#include <string.h>
+#include <vector>
+
+// Read-ahead for small reads that go to the file system (loose files, unmapped archive).
+// The window doubles while access stays sequential and falls back to the minimum after a
+// seek; reads at least as large as the window go straight to the source.
+struct ReadAhead {
+    static const DWORD kMinWindow = 4 * 1024;
+    static const DWORD kMaxWindow = 64 * 1024;
+
+    std::vector<BYTE> buffer;
+    LONGLONG bufferPos; // entry offset of buffer[0]
+    DWORD window; // next fill size, grows while reads stay sequential
+    LONGLONG lastReadEnd;
+
+    ReadAhead() : bufferPos(0), window(0), lastReadEnd(-1) {}
+
+    void Reset() { buffer.clear(); bufferPos = 0; window = 0; lastReadEnd = -1; }
+
+    // Reads [pos, pos + n) of an entry of entrySize bytes into out. fetch(pos, dst, len)
+    // reads from the source and returns the byte count; it is called at most once.
+    template <typename Fetch> DWORD Read(LONGLONG pos, BYTE* out, DWORD n, LONGLONG entrySize, Fetch fetch) {
+        LONGLONG bufferEnd = bufferPos + (LONGLONG)buffer.size();
+        if (pos >= bufferPos && pos + n <= bufferEnd) {
+            memcpy(out, buffer.data() + (pos - bufferPos), n);
+            lastReadEnd = pos + n;
+            return n;
+        }
+
+        if (pos != lastReadEnd || window == 0) window = kMinWindow;
+        else if (window < kMaxWindow) window *= 2;
+
+        DWORD br;
+        if (n >= window) {
+            br = fetch(pos, out, n);
+        } else {
+            LONGLONG left = entrySize - pos;
+            DWORD fill = left < (LONGLONG)window ? (DWORD)left : window;
+            buffer.resize(fill);
+            DWORD got = fetch(pos, buffer.data(), fill);
+            buffer.resize(got);
+            bufferPos = pos;
+            br = n < got ? n : got;
+            memcpy(out, buffer.data(), br);
+        }
+        lastReadEnd = pos + br;
+        return br;
+    }
+};
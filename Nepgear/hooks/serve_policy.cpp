@@ -0,0 +1,38 @@
+#include "../pch.h"
+#include "serve_policy.h"
+#include "config.h"
+#include <shlwapi.h>
+#include <string>
+#include <vector>
+
+#pragma comment(lib, "Shlwapi.lib")
+
+namespace {
+    std::vector<std::wstring> g_RealPatterns;
+    ULONGLONG g_RealMinBytes = 0;
+}
+
+namespace ServePolicy {
+    void Initialize() {
+        g_RealPatterns.clear();
+        std::wstring spec = Config::VFSRealHandleFiles;
+        size_t start = 0, end;
+        while ((end = spec.find(L'|', start)) != std::wstring::npos) {
+            if (end > start) g_RealPatterns.push_back(spec.substr(start, end - start));
+            start = end + 1;
+        }
+        if (start < spec.length()) g_RealPatterns.push_back(spec.substr(start));
+        g_RealMinBytes = (ULONGLONG)Config::VFSRealHandleMinKB * 1024;
+    }
+
+    Decision Choose(const wchar_t* path, DWORD size, BYTE usage) {
+        if (usage & USED_UNHOOKED) return { REAL, "passed to an API the VFS does not emulate" };
+        if (usage & USED_MAPPING) return { REAL, "mapped through a copied section" };
+        for (const auto& pattern : g_RealPatterns) {
+            // PathMatchSpec is case-insensitive and its '*' also spans directories
+            if (PathMatchSpecW(path, pattern.c_str())) return { REAL, "matches RealHandleFiles" };
+        }
+        if (g_RealMinBytes && size >= g_RealMinBytes) return { REAL, "at least RealHandleMinKB" };
+        return { EMULATE, "small entry" };
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <windows.h>
+
+// Per-entry choice of how an archive entry is served when [FileHook] VFSMode=2 (automatic):
+// an emulated handle (no extraction, decoded data shared in memory) or a real handle to an
+// extracted copy. Rules are checked in order: usage seen on an earlier emulated handle,
+// RealHandleFiles patterns, then the RealHandleMinKB size threshold.
+namespace ServePolicy {
+    enum Strategy : BYTE {
+        EMULATE,
+        REAL
+    };
+
+    // Usage seen on emulated handles of an entry; the VFS keeps these bits per index row.
+    enum Usage : BYTE {
+        USED_MAPPING = 1,  // mapped through a filled pagefile section (a full copy)
+        USED_UNHOOKED = 2  // passed to an API the VFS does not emulate
+    };
+
+    struct Decision {
+        Strategy strategy;
+        const char* reason;
+    };
+
+    void Initialize();
+    Decision Choose(const wchar_t* path, DWORD size, BYTE usage);
+}
@@ -0,0 +1,199 @@
+#include "../pch.h"
+#include "trace.h"
+#include "config.h"
+#include "utils.h"
+#include <shlwapi.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#pragma comment(lib, "Shlwapi.lib")
+
+namespace {
+    const LONG kRingEvents = 2048; // power of two
+    const DWORD kFlushIntervalMs = 100;
+
+    const char* const kKindNames[Trace::KIND_COUNT] = { "open", "read", "seek", "close", "decode", "extract" };
+
+    struct Event {
+        ULONGLONG start;
+        ULONGLONG end;
+        ULONGLONG size;
+        const std::string* name; // interned at record time, never freed
+        Trace::EventKind kind;
+    };
+
+    // Single producer (the owning thread) and single consumer (whoever holds g_FlushMutex).
+    // head is only written by the producer and tail only by the consumer; on x86/x64 the
+    // volatile accesses give the release/acquire ordering the handoff needs. Rings are never
+    // freed: a thread gives its ring up when it exits and the next new thread takes it over
+    // once the writer has drained it.
+    struct Ring {
+        DWORD threadId;
+        volatile LONG owned;
+        volatile LONG head;
+        volatile LONG tail;
+        volatile LONG dropped;
+        Ring* next;
+        Event events[kRingEvents];
+    };
+
+    Ring* volatile g_Rings = nullptr;
+    __declspec(thread) Ring* t_Ring = nullptr;
+
+    bool g_Enabled = false;
+    LARGE_INTEGER g_Frequency = { 0 };
+    ULONGLONG g_Origin = 0;
+    Trace::PathResolver g_Resolve = nullptr;
+
+    // row -> escaped UTF-8 path. Filled by the recording threads, so the writer never has to
+    // resolve rows itself; unordered_map nodes keep their address, so events can point at them.
+    std::mutex g_NamesMutex;
+    std::unordered_map<DWORD, std::string> g_Names;
+    const std::string g_NoName;
+    __declspec(thread) DWORD t_LastRow = MAXDWORD;
+    __declspec(thread) const std::string* t_LastName = nullptr;
+
+    std::mutex g_FlushMutex;
+    FILE* g_Output = nullptr;
+    ULONGLONG g_Written = 0;
+    HANDLE g_StopEvent = NULL;
+    HANDLE g_FlushThread = NULL;
+}
+
+static Ring* ThreadRing() {
+    if (t_Ring) return t_Ring;
+    for (Ring* ring = g_Rings; ring; ring = ring->next) {
+        if (ring->owned || ring->tail != ring->head) continue;
+        if (InterlockedCompareExchange(&ring->owned, 1, 0) != 0) continue;
+        ring->threadId = GetCurrentThreadId();
+        return t_Ring = ring;
+    }
+    Ring* ring = (Ring*)VirtualAlloc(NULL, sizeof(Ring), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (!ring) return nullptr;
+    ring->threadId = GetCurrentThreadId();
+    ring->owned = 1;
+    Ring* head;
+    do {
+        head = g_Rings;
+        ring->next = head;
+    } while (InterlockedCompareExchangePointer((PVOID volatile*)&g_Rings, ring, head) != head);
+    return t_Ring = ring;
+}
+
+// Resolves the row on the recording thread. The resolver runs without g_NamesMutex held,
+// since it may take locks the caller already holds.
+static const std::string* EntryName(DWORD row) {
+    if (row == MAXDWORD || !g_Resolve) return &g_NoName;
+    if (row == t_LastRow) return t_LastName;
+    {
+        std::lock_guard<std::mutex> lock(g_NamesMutex);
+        auto it = g_Names.find(row);
+        if (it != g_Names.end()) { t_LastRow = row; return t_LastName = &it->second; }
+    }
+    std::string name;
+    wchar_t path[MAX_PATH];
+    char utf8[MAX_PATH * 3];
+    if (g_Resolve(row, path) && WideCharToMultiByte(CP_UTF8, 0, path, -1, utf8, sizeof(utf8), NULL, NULL) > 0) {
+        for (const char* p = utf8; *p; p++) {
+            if (*p == '"' || *p == '\\') name += '\\';
+            if ((unsigned char)*p >= 0x20) name += *p;
+        }
+    }
+    std::lock_guard<std::mutex> lock(g_NamesMutex);
+    t_LastRow = row;
+    return t_LastName = &g_Names.emplace(row, std::move(name)).first->second;
+}
+
+static double ToMicros(ULONGLONG ticks) {
+    return (double)(ticks - g_Origin) * 1000000.0 / (double)g_Frequency.QuadPart;
+}
+
+// Must be called with g_FlushMutex held.
+static void DrainRings() {
+    if (!g_Output) return;
+    DWORD pid = GetCurrentProcessId();
+    for (Ring* ring = g_Rings; ring; ring = ring->next) {
+        LONG head = ring->head;
+        for (LONG i = ring->tail; i != head; i++) {
+            const Event& e = ring->events[i & (kRingEvents - 1)];
+            fprintf(g_Output, "%s{\"name\":\"%s\",\"cat\":\"vfs\",\"ph\":\"X\",\"pid\":%lu,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"path\":\"%s\",\"size\":%llu}}",
+                g_Written++ ? ",\n" : "", kKindNames[e.kind], pid, ring->threadId, ToMicros(e.start),
+                ToMicros(e.end) - ToMicros(e.start), e.name->c_str(), e.size);
+        }
+        ring->tail = head;
+    }
+    fflush(g_Output);
+}
+
+static DWORD WINAPI FlushWorker(LPVOID) {
+    while (WaitForSingleObject(g_StopEvent, kFlushIntervalMs) == WAIT_TIMEOUT) {
+        std::lock_guard<std::mutex> lock(g_FlushMutex);
+        DrainRings();
+    }
+    return 0;
+}
+
+namespace Trace {
+    void Initialize(PathResolver resolve) {
+        if (!Config::VFSTrace || g_Enabled) return;
+        wchar_t path[MAX_PATH];
+        GetModuleFileNameW(NULL, path, MAX_PATH);
+        PathRemoveFileSpecW(path);
+        PathAppendW(path, L"Nepgear_trace.json");
+        if (_wfopen_s(&g_Output, path, L"wb") != 0 || !g_Output) { g_Output = nullptr; return; }
+        fputs("[\n", g_Output); // the closing bracket is optional for trace viewers
+
+        QueryPerformanceFrequency(&g_Frequency);
+        LARGE_INTEGER now; QueryPerformanceCounter(&now);
+        g_Origin = now.QuadPart;
+        g_Resolve = resolve;
+        g_StopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (g_StopEvent) g_FlushThread = CreateThread(NULL, 0, FlushWorker, NULL, 0, NULL);
+        g_Enabled = true;
+        Utils::LogW(L"[VFS-Trace] Writing %s", path);
+    }
+
+    // Called from DLL_PROCESS_DETACH: the writer is signalled but not waited on, and the
+    // final drain is skipped if the writer is mid-flush rather than risk a lock inversion.
+    void Shutdown() {
+        if (!g_Enabled) return;
+        g_Enabled = false;
+        if (g_StopEvent) SetEvent(g_StopEvent);
+        if (g_FlushThread) { CloseHandle(g_FlushThread); g_FlushThread = NULL; }
+        std::unique_lock<std::mutex> lock(g_FlushMutex, std::try_to_lock);
+        if (!lock.owns_lock()) return;
+        DrainRings();
+        ULONGLONG dropped = 0;
+        for (Ring* ring = g_Rings; ring; ring = ring->next) dropped += ring->dropped;
+        fputs("\n]\n", g_Output);
+        fclose(g_Output);
+        g_Output = nullptr;
+        Utils::Log("[VFS-Trace] %llu events written, %llu dropped", g_Written, dropped);
+    }
+
+    void ThreadDetach() {
+        Ring* ring = t_Ring;
+        if (!ring) return;
+        t_Ring = nullptr;
+        ring->owned = 0;
+    }
+
+    ULONGLONG Now() {
+        if (!g_Enabled) return 0;
+        LARGE_INTEGER t; QueryPerformanceCounter(&t);
+        return t.QuadPart;
+    }
+
+    void Record(EventKind kind, DWORD row, ULONGLONG size, ULONGLONG start) {
+        if (!g_Enabled || !start) return;
+        Ring* ring = ThreadRing();
+        if (!ring) return;
+        LONG head = ring->head;
+        if (head - ring->tail >= kRingEvents) { ring->dropped++; return; }
+        Event& e = ring->events[head & (kRingEvents - 1)];
+        e.start = start; e.end = Now(); e.size = size; e.name = EntryName(row); e.kind = kind;
+        ring->head = head + 1;
+    }
+}
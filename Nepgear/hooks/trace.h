@@ -0,0 +1,43 @@
+#pragma once
+#include <windows.h>
+
+// Optional timeline of VFS file I/O. Each thread records into its own lock-free ring and a
+// background thread drains the rings into Nepgear_trace.json (Chrome trace / Perfetto
+// format) next to the game executable. When disabled every call returns immediately.
+namespace Trace {
+    enum EventKind : BYTE {
+        OPEN,
+        READ,
+        SEEK,
+        CLOSE,
+        DECODE,
+        EXTRACT,
+        KIND_COUNT
+    };
+
+    // Copies the path of an index row into path (MAX_PATH); called from the recording thread
+    // the first time it records the row.
+    typedef bool (*PathResolver)(DWORD row, wchar_t* path);
+
+    void Initialize(PathResolver resolve);
+    void Shutdown();
+    // From DLL_THREAD_DETACH: hands the exiting thread's ring over for reuse.
+    void ThreadDetach();
+
+    // Raw performance counter ticks, 0 when tracing is off.
+    ULONGLONG Now();
+    // row may be MAXDWORD when the event has no entry; size is bytes or a file position.
+    void Record(EventKind kind, DWORD row, ULONGLONG size, ULONGLONG start);
+
+    // Records [construction, destruction) unless Cancel is called.
+    struct Scope {
+        EventKind kind;
+        DWORD row;
+        ULONGLONG size;
+        ULONGLONG start;
+
+        explicit Scope(EventKind k, DWORD r = MAXDWORD) : kind(k), row(r), size(0), start(Now()) {}
+        ~Scope() { if (start) Record(kind, row, size, start); }
+        void Cancel() { start = 0; }
+    };
+}
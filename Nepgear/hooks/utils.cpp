@@ -309,6 +309,20 @@ namespace Utils {
         }
     }
 
+    // Same locations VFS::Initialize looks in: next to the module, then in the patch folder.
+    static bool HasArchiveFile(HMODULE hModule) {
+        wchar_t path[MAX_PATH];
+        GetModuleFileNameW(hModule, path, MAX_PATH);
+        PathRemoveFileSpecW(path);
+        wchar_t direct[MAX_PATH];
+        wcscpy_s(direct, path);
+        PathAppendW(direct, Config::ArchiveFileName);
+        if (PathFileExistsW(direct)) return true;
+        PathAppendW(path, Config::RedirectFolderW);
+        PathAppendW(path, Config::ArchiveFileName);
+        return PathFileExistsW(path) != FALSE;
+    }
+
     BOOL DeployPatchFiles(HMODULE hModule) {
         wchar_t rootPath[MAX_PATH];
         GetModuleFileNameW(NULL, rootPath, MAX_PATH);
@@ -329,7 +343,12 @@ namespace Utils {
             return true;
         };
 
-        if (VFS::IsActive()) {
+        // Deployed files must be on disk before DllMain returns: LoaderDll.dll for locale
+        // emulation right after this, DLLs and ini files the game reads at startup. Archive
+        // contents need the index, so only a patch with an archive waits for it here; a
+        // folder-only patch is copied directly and leaves the build on the worker.
+        bool useVfs = HasArchiveFile(hModule) && VFS::WaitUntilReady();
+        if (useVfs) {
             std::vector<std::wstring> vfsFiles;
             VFS::GetVirtualFileList(vfsFiles);
             for (const auto& relPath : vfsFiles) {
@@ -370,7 +389,7 @@ namespace Utils {
 
             bool deployed = false;
 
-            if (VFS::IsActive() && VFS::HasVirtualFile(fileName.c_str())) {
+            if (useVfs && VFS::HasVirtualFile(fileName.c_str())) {
                 deployed = VFS::ExtractFile(fileName.c_str(), dstPath);
                 if (deployed && Config::EnableDebug) {
                     Log("[Deploy] Extracted %S from VFS", fileName.c_str());
@@ -554,4 +573,15 @@ namespace Utils {
         }
         return nullptr;
     }
+
+    // FNV-1a; pass a previous result as seed to hash several fields in sequence.
+    ULONGLONG HashBytes(const void* data, size_t size, ULONGLONG seed) {
+        const BYTE* p = (const BYTE*)data;
+        ULONGLONG hash = seed;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= p[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
 }
@@ -19,4 +19,5 @@ namespace Utils {
     void CleanupPatchFiles();
     PVOID FindPattern(HMODULE hModule, const char* signature);
     PVOID FindPatternInBlock(void* startAddress, size_t size, const char* signature);
+    ULONGLONG HashBytes(const void* data, size_t size, ULONGLONG seed = 14695981039346656037ULL);
 }
@@ -2,6 +2,15 @@
 #include "vfs.h"
 #include "config.h"
 #include "utils.h"
+#include "extract_cache.h"
+#include "loose_scan.h"
+#include "metrics.h"
+#include "trace.h"
+#include "cipher.h"
+#include "serve_policy.h"
+#include "path_key.h"
+#include "path_filter.h"
+#include "file_hook.h"
 #include <shlwapi.h>
 #include <compressapi.h>
 #include <mutex>
@@ -9,6 +18,9 @@
 #include <algorithm>
 #include <unordered_map>
 #include <set>
+#include <unordered_set>
+#include <list>
+#include <deque>
 
 #pragma comment(lib, "Shlwapi.lib")
 #pragma comment(lib, "cabinet.lib")
@@ -22,6 +34,7 @@ typedef BOOL(WINAPI* pFindNextFileW)(HANDLE, LPWIN32_FIND_DATAW);
 typedef BOOL(WINAPI* pFindClose)(HANDLE);
 typedef HANDLE(WINAPI* pFindFirstFileA)(LPCSTR, LPWIN32_FIND_DATAA);
 typedef BOOL(WINAPI* pFindNextFileA)(HANDLE, LPWIN32_FIND_DATAA);
+typedef BOOL(WINAPI* pCompareObjectHandles)(HANDLE, HANDLE);
 
 // Shared Global State
 static pReadFile g_OrigReadFile = nullptr;
@@ -39,26 +52,449 @@ static pCloseHandle g_RawCloseHandle = nullptr;
 static pCreateFileW g_RawCreateFileW = nullptr;
 
 namespace {
+    FILETIME g_ArchiveWriteTime = { 0 };
+
+    // Flat little-endian records for the index snapshot; arrays are a DWORD count plus raw elements.
+    template <typename T> void PutPod(std::vector<BYTE>& out, const T& v) {
+        out.insert(out.end(), (const BYTE*)&v, (const BYTE*)&v + sizeof(T));
+    }
+    template <typename T> void PutArray(std::vector<BYTE>& out, const T* data, size_t count) {
+        PutPod(out, (DWORD)count);
+        out.insert(out.end(), (const BYTE*)data, (const BYTE*)(data + count));
+    }
+
+    struct SnapshotReader {
+        const BYTE* p;
+        const BYTE* end;
+        bool ok;
+
+        template <typename T> T Pod() {
+            T v = T();
+            if (!ok || (size_t)(end - p) < sizeof(T)) { ok = false; return v; }
+            memcpy(&v, p, sizeof(T)); p += sizeof(T);
+            return v;
+        }
+        template <typename T> void Array(std::vector<T>& v) {
+            DWORD count = Pod<DWORD>();
+            if (!ok || (size_t)(end - p) / sizeof(T) < count) { ok = false; return; }
+            v.resize(count);
+            memcpy(v.data(), p, (size_t)count * sizeof(T)); p += (size_t)count * sizeof(T);
+        }
+        std::wstring String() {
+            std::vector<wchar_t> s; Array(s);
+            return std::wstring(s.begin(), s.end());
+        }
+    };
+
+    // Structure-of-arrays file index: one row per file across parallel columns, every path
+    // stored once in a NUL-terminated UTF-16 arena, and an open-addressed table of row
+    // numbers for lookups. Loose rows reuse the offset column for their last write time.
+    // Rows are never moved or reused for another path, so row numbers stay valid; a
+    // removed row is only flagged and comes back in place if its path is added again.
+    class FileIndex {
+    public:
+        static constexpr DWORD kNone = MAXDWORD;
+        enum : BYTE { kLooseFile = 1, kRemoved = 2 };
+
+        size_t Size() const { return m_Offsets.size(); }
+        const wchar_t* Path(DWORD row) const { return m_Arena.data() + m_PathOffsets[row]; }
+        bool IsLoose(DWORD row) const { return (m_Flags[row] & kLooseFile) != 0; }
+        bool IsRemoved(DWORD row) const { return (m_Flags[row] & kRemoved) != 0; }
+
+        DWORD Find(const wchar_t* path) const {
+            DWORD row = FindRow(path);
+            return (row != kNone && IsRemoved(row)) ? kNone : row;
+        }
+
+        VFS::VirtualFileEntry Entry(DWORD row) const {
+            VFS::VirtualFileEntry e;
+            e.index = row;
+            e.size = m_Sizes[row];
+            e.decompressedSize = m_DecompressedSizes[row];
+            e.isLooseFile = IsLoose(row);
+            e.offset = e.isLooseFile ? 0 : m_Offsets[row];
+            if (e.isLooseFile) {
+                e.lastWriteTime.dwLowDateTime = (DWORD)m_Offsets[row];
+                e.lastWriteTime.dwHighDateTime = (DWORD)((ULONGLONG)m_Offsets[row] >> 32);
+            } else {
+                e.lastWriteTime = g_ArchiveWriteTime;
+            }
+            return e;
+        }
+
+        // Adds a row unless the path is already indexed (loose files shadow the archive).
+        bool Add(const wchar_t* path, LONGLONG offset, DWORD size, DWORD decompressedSize, BYTE flags) {
+            DWORD existing = FindRow(path);
+            if (existing != kNone) {
+                if (!IsRemoved(existing)) return false;
+                Set(existing, offset, size, decompressedSize, flags);
+                return true;
+            }
+            if ((Size() + 1) * 2 > m_Slots.size()) Rehash(max((size_t)1024, m_Slots.size() * 2));
+            DWORD row = (DWORD)Size();
+            const wchar_t* p = SkipLeadingSeparators(path);
+            m_PathOffsets.push_back((DWORD)m_Arena.size());
+            m_Arena.insert(m_Arena.end(), p, p + wcslen(p) + 1);
+            m_Offsets.push_back(offset);
+            m_Sizes.push_back(size);
+            m_DecompressedSizes.push_back(decompressedSize);
+            m_Flags.push_back(flags);
+            InsertSlot(row);
+            return true;
+        }
+
+        void Compact() {
+            m_Arena.shrink_to_fit(); m_PathOffsets.shrink_to_fit(); m_Offsets.shrink_to_fit();
+            m_Sizes.shrink_to_fit(); m_DecompressedSizes.shrink_to_fit(); m_Flags.shrink_to_fit();
+        }
+
+        void Set(DWORD row, LONGLONG offset, DWORD size, DWORD decompressedSize, BYTE flags) {
+            m_Offsets[row] = offset;
+            m_Sizes[row] = size;
+            m_DecompressedSizes[row] = decompressedSize;
+            m_Flags[row] = flags;
+        }
+
+        void Remove(DWORD row) { m_Flags[row] |= kRemoved; }
+
+        // Loose rows can come from an index snapshot taken before the file was edited in place
+        void UpdateLoose(DWORD row, DWORD size, const FILETIME& writeTime) {
+            Set(row, ((LONGLONG)writeTime.dwHighDateTime << 32) | writeTime.dwLowDateTime, size, size, kLooseFile);
+        }
+
+        void Clear() { *this = FileIndex(); }
+
+        // Columns and the slot table are written as-is, so loading is a bulk copy with no rehashing.
+        void Save(std::vector<BYTE>& out) const {
+            PutArray(out, m_Arena.data(), m_Arena.size());
+            PutArray(out, m_Slots.data(), m_Slots.size());
+            PutArray(out, m_PathOffsets.data(), m_PathOffsets.size());
+            PutArray(out, m_Offsets.data(), m_Offsets.size());
+            PutArray(out, m_Sizes.data(), m_Sizes.size());
+            PutArray(out, m_DecompressedSizes.data(), m_DecompressedSizes.size());
+            PutArray(out, m_Flags.data(), m_Flags.size());
+        }
+
+        bool Load(SnapshotReader& r) {
+            FileIndex index;
+            r.Array(index.m_Arena); r.Array(index.m_Slots); r.Array(index.m_PathOffsets); r.Array(index.m_Offsets);
+            r.Array(index.m_Sizes); r.Array(index.m_DecompressedSizes); r.Array(index.m_Flags);
+            size_t rows = index.m_PathOffsets.size(), slots = index.m_Slots.size();
+            if (!r.ok || index.m_Offsets.size() != rows || index.m_Sizes.size() != rows ||
+                index.m_DecompressedSizes.size() != rows || index.m_Flags.size() != rows) return false;
+            if (rows && (slots < rows * 2 || (slots & (slots - 1)) || index.m_Arena.empty() || index.m_Arena.back() != L'\0')) return false;
+            for (DWORD offset : index.m_PathOffsets) if (offset >= index.m_Arena.size()) return false;
+            for (DWORD slot : index.m_Slots) if (slot > rows) return false;
+            *this = std::move(index);
+            return true;
+        }
+
+        size_t MemoryUsage() const {
+            return m_Arena.capacity() * sizeof(wchar_t) + m_Slots.capacity() * sizeof(DWORD)
+                + m_PathOffsets.capacity() * sizeof(DWORD) + m_Offsets.capacity() * sizeof(LONGLONG)
+                + (m_Sizes.capacity() + m_DecompressedSizes.capacity()) * sizeof(DWORD) + m_Flags.capacity();
+        }
+
+    private:
+        DWORD FindRow(const wchar_t* path) const {
+            if (m_Slots.empty()) return kNone;
+            size_t mask = m_Slots.size() - 1;
+            for (size_t i = PathHash::Hash(path) & mask; m_Slots[i]; i = (i + 1) & mask) {
+                if (PathEqual::Equal(Path(m_Slots[i] - 1), path)) return m_Slots[i] - 1;
+            }
+            return kNone;
+        }
+
+        void InsertSlot(DWORD row) {
+            size_t mask = m_Slots.size() - 1;
+            size_t i = PathHash::Hash(Path(row)) & mask;
+            while (m_Slots[i]) i = (i + 1) & mask;
+            m_Slots[i] = row + 1;
+        }
+
+        void Rehash(size_t slotCount) {
+            m_Slots.assign(slotCount, 0);
+            for (DWORD row = 0; row < Size(); row++) InsertSlot(row);
+        }
+
+        std::vector<wchar_t> m_Arena;
+        std::vector<DWORD> m_Slots; // row + 1, 0 = empty; power of two, at most half full
+        std::vector<DWORD> m_PathOffsets;
+        std::vector<LONGLONG> m_Offsets;
+        std::vector<DWORD> m_Sizes;
+        std::vector<DWORD> m_DecompressedSizes;
+        std::vector<BYTE> m_Flags;
+    };
+
+    // Keys for the narrow APIs: every row's path encoded once in the configured codepage and
+    // folded like PathHash, so A callers are looked up by their own bytes. Folding steps over
+    // DBCS trail bytes, which can fall in the ASCII range (0x5C in Shift-JIS). Rows whose path
+    // has no exact encoding in the codepage get no key.
+    class NarrowIndex {
+    public:
+        static constexpr DWORD kNoKey = MAXDWORD;
+
+        void Build(const FileIndex& index, UINT codepage) {
+            *this = NarrowIndex();
+            m_Codepage = codepage;
+            for (int b = 0x80; b < 256; b++) m_LeadByte[b] = IsDBCSLeadByteEx(codepage, (BYTE)b) != FALSE;
+            m_KeyOffsets.reserve(index.Size());
+            Sync(index);
+        }
+
+        // Keys the rows added to index since the last call; removed rows keep theirs and are
+        // filtered by the caller, and a revived row comes back under the same path.
+        void Sync(const FileIndex& index) {
+            if (m_Codepage == MAXDWORD) return;
+            if (index.Size() * 2 > m_Slots.size()) {
+                size_t slots = 1024;
+                while (index.Size() * 2 > slots) slots *= 2;
+                m_Slots.assign(slots, 0);
+                for (DWORD row = 0; row < (DWORD)m_KeyOffsets.size(); row++) InsertSlot(row);
+            }
+            bool utf8 = m_Codepage == CP_UTF8;
+            for (DWORD row = (DWORD)m_KeyOffsets.size(); row < index.Size(); row++) {
+                char key[MAX_PATH * 4];
+                BOOL lossy = FALSE;
+                int n = WideCharToMultiByte(m_Codepage, utf8 ? 0 : WC_NO_BEST_FIT_CHARS, index.Path(row), -1,
+                    key, sizeof(key), NULL, utf8 ? NULL : &lossy);
+                if (n <= 0 || lossy) { m_KeyOffsets.push_back(kNoKey); continue; }
+                m_KeyOffsets.push_back((DWORD)m_Arena.size());
+                ForEachFolded(key, [&](char c) { m_Arena.push_back(c); });
+                m_Arena.push_back('\0');
+                InsertSlot(row);
+            }
+        }
+
+        // Returns the row keyed by path, or FileIndex::kNone. ascii is set when path has no
+        // bytes above 0x7F, in which case a miss is final; other bytes can have several
+        // encodings of one character, so those misses still need the wide lookup.
+        DWORD Find(const char* path, bool* ascii) const {
+            bool plain = true;
+            size_t h = Hash(path, &plain);
+            *ascii = plain && !m_Slots.empty();
+            if (m_Slots.empty()) return FileIndex::kNone;
+            size_t mask = m_Slots.size() - 1;
+            for (size_t i = h & mask; m_Slots[i]; i = (i + 1) & mask) {
+                DWORD row = m_Slots[i] - 1;
+                if (Equal(m_Arena.data() + m_KeyOffsets[row], path)) return row;
+            }
+            return FileIndex::kNone;
+        }
+
+        size_t MemoryUsage() const {
+            return m_Arena.capacity() + (m_Slots.capacity() + m_KeyOffsets.capacity()) * sizeof(DWORD);
+        }
+
+    private:
+        template <typename F> void ForEachFolded(const char* p, F emit) const {
+            while (*p == '\\' || *p == '/') p++;
+            for (; *p; ++p) {
+                if (m_LeadByte[(BYTE)*p] && p[1]) { emit(p[0]); emit(*++p); continue; }
+                emit((char)FoldPathChar((wchar_t)(BYTE)*p));
+            }
+        }
+
+        size_t Hash(const char* p, bool* ascii) const {
+            size_t h = (size_t)14695981039346656037ULL;
+            ForEachFolded(p, [&](char c) {
+                if ((BYTE)c >= 0x80) *ascii = false;
+                h ^= (size_t)(BYTE)c;
+                h *= (size_t)1099511628211ULL;
+            });
+            return h;
+        }
+
+        bool Equal(const char* key, const char* p) const {
+            bool match = true;
+            ForEachFolded(p, [&](char c) { if (match) match = *key++ == c; });
+            return match && *key == '\0';
+        }
+
+        void InsertSlot(DWORD row) {
+            if (m_KeyOffsets[row] == kNoKey) return;
+            bool ascii;
+            size_t mask = m_Slots.size() - 1;
+            size_t i = Hash(m_Arena.data() + m_KeyOffsets[row], &ascii) & mask;
+            while (m_Slots[i]) i = (i + 1) & mask;
+            m_Slots[i] = row + 1;
+        }
+
+        UINT m_Codepage = MAXDWORD; // MAXDWORD until built
+        bool m_LeadByte[256] = {};
+        std::vector<char> m_Arena;
+        std::vector<DWORD> m_Slots; // row + 1, 0 = empty; power of two, at most half full
+        std::vector<DWORD> m_KeyOffsets; // per FileIndex row, kNoKey if the path has no encoding
+    };
+
     struct VirtualFindState {
         HANDLE realHandle;
         bool usingRealHandle;
-        std::vector<std::wstring> seenFiles;
-        std::vector<VFS::VirtualFileEntry*> matches;
+        std::unordered_set<std::wstring, PathHash, PathEqual> seenFiles; // names returned by the real search
+        std::vector<DWORD> matches; // index rows
         size_t matchIndex;
 
         VirtualFindState() : realHandle(INVALID_HANDLE_VALUE), usingRealHandle(false), matchIndex(0) {}
-        ~VirtualFindState() {
-            // We should use the original CloseHandle if we have it
-            // but the state doesn't know about it. 
-            // In practice, VirtualFindClose handles the realHandle.
+
+        // VirtualFindClose closes realHandle; the containers keep their storage for the next search
+        void Reset() {
+            realHandle = INVALID_HANDLE_VALUE; usingRealHandle = false;
+            seenFiles.clear(); matches.clear(); matchIndex = 0;
+        }
+    };
+
+    // Preallocated slots for emulated handles. A handle value is kHandleBase | kind | generation | slot,
+    // so resolving one is a bounds check and a compare, and a closed handle stops matching as soon as
+    // its slot is released. Slots live in pages that are never freed, which lets IsVirtualHandle
+    // validate without the lock; T is reused in place and must provide Reset().
+    const uintptr_t kHandleBase = 0xBF000000; // file_hook's IsVirtualHandleRange covers the whole 24-bit block
+    const DWORD kHandleSlotBits = 13;
+    const DWORD kHandleGenerationBits = 10;
+    const DWORD kHandleKindShift = kHandleSlotBits + kHandleGenerationBits;
+
+    template <typename T, uintptr_t Kind>
+    class HandleTable {
+    public:
+        static const DWORD kCapacity = 1 << kHandleSlotBits;
+        static const DWORD kPageSlots = 256;
+
+        HandleTable() : m_Used(0), m_Live(0) { ZeroMemory((void*)m_Pages, sizeof(m_Pages)); }
+        ~HandleTable() { for (DWORD i = 0; i < kCapacity / kPageSlots; i++) delete[] m_Pages[i]; }
+
+        DWORD Live() const { return m_Live; }
+
+        T* Get(HANDLE h) const {
+            uintptr_t v = (uintptr_t)h;
+            if (v - kHandleBase >= ((uintptr_t)2 << kHandleKindShift) || ((v - kHandleBase) >> kHandleKindShift) != Kind) return nullptr;
+            DWORD index = (DWORD)(v & (kCapacity - 1));
+            Slot* page = m_Pages[index / kPageSlots];
+            if (!page) return nullptr;
+            Slot& s = page[index % kPageSlots];
+            return s.handle == v ? &s.value : nullptr;
+        }
+
+        // Returns INVALID_HANDLE_VALUE when every slot is in use. Must be called under g_Mutex.
+        HANDLE Alloc(T** value) {
+            DWORD index;
+            if (!m_Free.empty()) { index = m_Free.front(); m_Free.pop_front(); }
+            else if (m_Used < kCapacity) {
+                index = m_Used;
+                if (index % kPageSlots == 0) m_Pages[index / kPageSlots] = new Slot[kPageSlots];
+                m_Used++;
+            } else return INVALID_HANDLE_VALUE;
+            Slot& s = m_Pages[index / kPageSlots][index % kPageSlots];
+            s.handle = kHandleBase | (Kind << kHandleKindShift) | ((uintptr_t)s.generation << kHandleSlotBits) | index;
+            m_Live++;
+            *value = &s.value;
+            return (HANDLE)s.handle;
         }
+
+        // Released slots are reused oldest first, so a generation only wraps after
+        // 2^kHandleGenerationBits reuses of every free slot. Must be called under g_Mutex.
+        void Free(HANDLE h) {
+            if (!Get(h)) return;
+            DWORD index = (DWORD)((uintptr_t)h & (kCapacity - 1));
+            Slot& s = m_Pages[index / kPageSlots][index % kPageSlots];
+            s.handle = 0;
+            s.generation = (s.generation + 1) & ((1 << kHandleGenerationBits) - 1);
+            s.value.Reset();
+            m_Free.push_back(index);
+            m_Live--;
+        }
+
+        void Clear() {
+            for (DWORD i = 0; i < m_Used; i++) {
+                Slot& s = m_Pages[i / kPageSlots][i % kPageSlots];
+                if (s.handle) Free((HANDLE)s.handle);
+            }
+        }
+
+    private:
+        struct Slot {
+            volatile uintptr_t handle; // 0 while free
+            DWORD generation;
+            T value;
+
+            Slot() : handle(0), generation(0) {}
+        };
+
+        Slot* volatile m_Pages[kCapacity / kPageSlots];
+        DWORD m_Used; // slots ever handed out
+        DWORD m_Live;
+        std::deque<DWORD> m_Free;
     };
 
-    std::unordered_map<std::wstring, VFS::VirtualFileEntry> g_FileIndex;
-    std::unordered_map<std::wstring, std::vector<VFS::VirtualFileEntry*>> g_DirectoryIndex;
-    std::unordered_map<HANDLE, std::unique_ptr<VFS::VirtualFileHandle>> g_HandleMap;
-    std::unordered_map<HANDLE, std::unique_ptr<VirtualFindState>> g_FindMap;
+    FileIndex g_FileIndex;
+    NarrowIndex g_NarrowIndex; // g_FileIndex keyed by Config::LE_Codepage bytes
+    std::unordered_map<std::wstring, std::vector<DWORD>> g_DirectoryIndex;
+
+    // Every path component in the index; tested without the lock, added to under g_Mutex
+    PathFilter g_PathFilter;
+
+    // Absolute paths, as the game passed them, that a thread recently resolved: row is the
+    // entry, or kNone for a path that is not virtual. Valid for one index generation.
+    struct PathCacheSlot {
+        ULONGLONG hash;
+        LONG generation;
+        DWORD row;
+    };
+    const DWORD kPathCacheSlots = 16;
+    __declspec(thread) PathCacheSlot t_PathCache[kPathCacheSlots];
+    __declspec(thread) ULONGLONG t_QueryKey = 0; // path last given to MayBeVirtual(A), 0 if relative
+    volatile LONG g_IndexGeneration = 0; // bumped by every live reload change and by Shutdown
+    HandleTable<VFS::VirtualFileHandle, 0> g_HandleTable;
+    HandleTable<VirtualFindState, 1> g_FindTable;
     std::unordered_map<HANDLE, std::wstring> g_MixedHandleMap; // Modern mode cache mapping
+
+    // Sections handed out for stored archive entries are duplicates of the archive's own
+    // section. Only entries starting on an allocation-granularity boundary qualify, so every
+    // view is the caller's offset moved by the entry's and never needs adjusting afterwards.
+    // The view hooks sit on NtMapViewOfSection, which runs under the loader lock for every
+    // image load, so the table has its own lock instead of g_Mutex.
+    struct DirectMapping {
+        LONGLONG offset;
+        DWORD size;
+    };
+    std::unordered_map<HANDLE, DirectMapping> g_DirectMappings;
+    std::mutex g_DirectMutex;
+    volatile LONG g_DirectObjects = 0; // lets the hooks skip the lock while there are none
+
+    // Modern mode extraction running on a worker thread. Threads that need the entry
+    // wait on its event without holding g_Mutex, so other VFS calls keep going.
+    struct ExtractJob {
+        ULONGLONG key;
+        VFS::VirtualFileEntry entry;
+        HANDLE done;
+        bool succeeded;
+        bool inMemory; // into a memory file instead of the disk cache
+        wchar_t path[MAX_PATH];
+
+        ExtractJob() : key(0), entry(), done(CreateEventW(NULL, TRUE, FALSE, NULL)), succeeded(false), inMemory(false) { path[0] = L'\0'; }
+        ~ExtractJob() { if (done) CloseHandle(done); }
+    };
+    std::unordered_map<ULONGLONG, std::shared_ptr<ExtractJob>> g_ExtractJobs; // pending, by cache key
+
+    // Modern mode entries extracted into temporary delete-on-close files, which the cache
+    // manager keeps in memory instead of writing them out. The VFS holds one handle per file
+    // and hands the game read-only handles of its own; the kernel deletes the file once the
+    // last of them is closed, so evicting only drops the VFS handle.
+    struct MemoryFile {
+        HANDLE file;
+        DWORD size;
+        std::wstring path; // unique per extraction: an evicted file can stay delete-pending
+        std::list<ULONGLONG>::iterator lruPos;
+    };
+    std::unordered_map<ULONGLONG, MemoryFile> g_MemoryFiles; // by extraction cache key
+    std::list<ULONGLONG> g_MemoryLru; // front = most recently opened
+    size_t g_MemoryFileBytes = 0;
+    size_t g_MemoryFileBudget = 0;
+    volatile LONG g_MemoryFileSequence = 0;
+
+    // Automatic mode, per index row: ServePolicy::Usage bits seen on emulated handles, and the
+    // strategy last logged (0 = none yet, else Strategy + 1) so each change is logged once.
+    std::vector<BYTE> g_RowUsage;
+    std::vector<BYTE> g_RowLogged;
+
     std::recursive_mutex g_Mutex;
 
     // RAII helper for Windows handles using the raw CloseHandle
@@ -78,12 +514,102 @@ namespace {
         operator DECOMPRESSOR_HANDLE() const { return h; }
     };
 
+    // Read-only file mapping of the archive. x64 maps the whole file once,
+    // x86 keeps a single sliding window to stay out of the 2 GB address space.
+    struct ArchiveMapping {
+        HANDLE hMapping;
+        LONGLONG fileSize;
+        const BYTE* view;
+        LONGLONG viewOffset;
+        SIZE_T viewSize;
+        DWORD granularity;
+        DWORD pageSize;
+
+        ArchiveMapping() : hMapping(NULL), fileSize(0), view(nullptr), viewOffset(0), viewSize(0), granularity(65536), pageSize(4096) {}
+    };
+
+    const DWORD kChunkedMagic = 0x5A43504E; // "NPCZ", written by Packer for large files
+    const DWORD kSnapshotMagic = 0x5849504E; // "NPIX"
+    const DWORD kSnapshotVersion = 1;
+    const DWORD kSnapshotHeadBytes = 64 * 1024;
+
+    // The inputs an index snapshot was built from; it is only used when all of them match.
+    struct SnapshotSource {
+        ULONGLONG pathHash; // archive and redirect folder locations
+        LONGLONG archiveSize; // -1 without an archive
+        FILETIME archiveWriteTime;
+        ULONGLONG archiveHeadHash; // first 64 KB of the archive
+    };
+    const DWORD kExtractBlockSize = 4 * 1024 * 1024;
+
+#ifdef _WIN64
+    const SIZE_T kArchiveWindowSize = 0; // whole file
+#else
+    const SIZE_T kArchiveWindowSize = 32 * 1024 * 1024;
+#endif
+
     HANDLE g_ArchiveHandle = INVALID_HANDLE_VALUE;
+    ArchiveMapping g_ArchiveMap;
+    bool g_ArchiveEncrypted = false; // payloads need Cipher::Apply with g_ArchiveKey after every read
+    Cipher::Key g_ArchiveKey;
+    LONGLONG g_ArchiveDataStart = 0; // entry count offset, past the cipher header if there is one
+
+    // Process-wide cache of decompressed entries, shared by every handle on the same entry.
+    // Eviction only drops the cache's reference; open handles keep their buffer alive.
+    typedef std::shared_ptr<const std::vector<BYTE>> DecodedBuffer;
+    struct DecodedCacheSlot {
+        DecodedBuffer data;
+        std::list<DWORD>::iterator lruPos;
+        bool prefetched; // inserted by the prefetch worker and not yet opened
+    };
+    std::unordered_map<DWORD, DecodedCacheSlot> g_DecodedCache; // by index row
+    std::list<DWORD> g_DecodedLru; // front = most recently used
+    size_t g_DecodedCacheBytes = 0;
+    size_t g_DecodedCacheBudget = 0;
+    ULONGLONG g_DecodedCacheHits = 0;
+    ULONGLONG g_DecodedCacheMisses = 0;
+
+    // Low-priority worker that decodes predicted next entries into the decoded cache.
+    // Predictions come from sequential file names and previously observed open order.
+    const size_t kPrefetchQueueLimit = 16;
+    const int kPrefetchSequenceDepth = 2;
+    HANDLE g_PrefetchThread = NULL;
+    HANDLE g_PrefetchEvent = NULL;
+    volatile bool g_PrefetchStop = false;
+    std::deque<DWORD> g_PrefetchQueue;
+    std::unordered_map<DWORD, DWORD> g_AccessSuccessor;
+    DWORD g_LastOpened = FileIndex::kNone;
+    ULONGLONG g_PrefetchDecoded = 0;
+    ULONGLONG g_PrefetchUsed = 0;
+
+    // Live reload: a watcher thread applies redirect folder changes to the index. Archive
+    // entries hidden by a loose file are kept here so they return when the file is deleted.
+    struct ShadowedEntry {
+        LONGLONG offset;
+        DWORD size;
+        DWORD decompressedSize;
+    };
+    std::unordered_map<std::wstring, ShadowedEntry, PathHash, PathEqual> g_ShadowedArchive;
+    HANDLE g_WatchThread = NULL;
+    HANDLE g_WatchStopEvent = NULL;
+    volatile bool g_WatchStop = false;
+
     wchar_t g_ArchivePath[MAX_PATH] = { 0 };
     wchar_t g_LooseFolderPath[MAX_PATH] = { 0 };
     wchar_t g_HybridCacheDir[MAX_PATH] = { 0 };
+    std::wstring g_GameRootDir; // normalized, resolved once in Initialize
+    ULONGLONG g_ArchiveId = 0; // hash of the archive size and header index
     bool g_IsActive = false;
-    uintptr_t g_VirtualHandleCounter = 0xBF000000;
+
+    // The index is built on a worker started from DllMain; lookups wait on g_InitDone only if
+    // the game asks for a file before it is ready.
+    enum : LONG { kInitIdle, kInitRunning, kInitDone };
+    volatile LONG g_InitState = kInitIdle;
+    HANDLE g_InitDone = NULL; // manual-reset, set together with kInitDone
+    DWORD g_InitThreadId = 0;
+    HMODULE g_InitModule = NULL;
+    ULONGLONG g_InitStartTick = 0;
+    volatile LONGLONG g_FirstWaitTick = 0; // when a lookup first had to wait, 0 if none did
 }
 
 // Utility Functions
@@ -94,187 +620,1332 @@ static std::wstring NormalizePath(const wchar_t* path) {
     normalized.reserve(MAX_PATH);
     
     // Skip leading backslashes
-    const wchar_t* p = path;
-    while (*p == L'\\' || *p == L'/') p++;
-    
-    for (; *p != L'\0'; ++p) {
-        wchar_t c = *p;
-        if (c == L'/') c = L'\\';
-        else if (c >= L'A' && c <= L'Z') c += (L'a' - L'A');
-        normalized += c;
+    for (const wchar_t* p = SkipLeadingSeparators(path); *p != L'\0'; ++p) {
+        normalized += FoldPathChar(*p);
     }
     return normalized;
 }
 
-static std::wstring NormalizePathA(const char* path) {
-    if (!path || path[0] == '\0') return L"";
-    wchar_t wpath[MAX_PATH];
-    if (MultiByteToWideChar(Config::LE_Codepage, 0, path, -1, wpath, MAX_PATH) == 0) return L"";
-    return NormalizePath(wpath);
+// Loose files are not stored with their full path; it is rebuilt from the folder root.
+static bool GetLoosePath(DWORD row, wchar_t* out) {
+    wcscpy_s(out, MAX_PATH, g_LooseFolderPath);
+    return PathAppendW(out, g_FileIndex.Path(row)) != FALSE;
+}
+
+// Converts an ANSI path into a stack buffer for index lookups; no heap allocation.
+static bool WidenPathA(const char* path, wchar_t* wpath) {
+    if (!path || path[0] == '\0') return false;
+    return MultiByteToWideChar(Config::LE_Codepage, 0, path, -1, wpath, MAX_PATH) != 0;
+}
+
+// Looks a narrow path up by its own bytes; only non-ASCII misses are widened and retried.
+static DWORD FindRowA(const char* path) {
+    if (!path || path[0] == '\0') return FileIndex::kNone;
+    bool ascii;
+    DWORD row = g_NarrowIndex.Find(path, &ascii);
+    if (row != FileIndex::kNone) return g_FileIndex.IsRemoved(row) ? FileIndex::kNone : row;
+    wchar_t w[MAX_PATH];
+    if (ascii || !WidenPathA(path, w)) return FileIndex::kNone;
+    return g_FileIndex.Find(w);
+}
+
+// Direct mapping entries are keyed by handle value. A mapping closed without CloseHandle
+// (NtClose, DUPLICATE_CLOSE_SOURCE) leaves its entry behind, and the value can come back
+// as an unrelated section; an entry is only used while its handle still names the archive
+// section. Before Windows 10 there is no CompareObjectHandles and only a closed handle is caught.
+static bool IsArchiveSectionHandle(HANDLE h) {
+    static const pCompareObjectHandles compare = []() -> pCompareObjectHandles {
+        HMODULE kernelBase = GetModuleHandleW(L"kernelbase.dll");
+        return kernelBase ? (pCompareObjectHandles)GetProcAddress(kernelBase, "CompareObjectHandles") : nullptr;
+    }();
+    if (compare) return compare(h, g_ArchiveMap.hMapping) != FALSE;
+    DWORD flags;
+    return GetHandleInformation(h, &flags) != FALSE;
+}
+
+enum FindPatternKind { FIND_MATCH_ALL, FIND_MATCH_EXTENSION, FIND_MATCH_SPEC };
+
+// "*" and "*.*" match everything and "*.ext" is a suffix compare; only other
+// patterns need PathMatchSpecW.
+static FindPatternKind ClassifyFindPattern(const std::wstring& pattern, std::wstring& suffix) {
+    if (pattern == L"*" || pattern == L"*.*") return FIND_MATCH_ALL;
+    if (pattern.length() > 2 && pattern[0] == L'*' && pattern[1] == L'.' &&
+        pattern.find_first_of(L"*?;", 1) == std::wstring::npos) {
+        suffix = pattern.substr(1);
+        return FIND_MATCH_EXTENSION;
+    }
+    return FIND_MATCH_SPEC;
+}
+
+static bool MatchFindPattern(const wchar_t* name, FindPatternKind kind, const std::wstring& pattern, const std::wstring& suffix) {
+    if (kind == FIND_MATCH_ALL) return true;
+    if (kind == FIND_MATCH_EXTENSION) {
+        size_t len = wcslen(name);
+        return len >= suffix.length() && _wcsicmp(name + len - suffix.length(), suffix.c_str()) == 0;
+    }
+    return PathMatchSpecW(name, pattern.c_str()) != FALSE;
+}
+
+static std::wstring DirectoryKey(DWORD row) {
+    std::wstring path = g_FileIndex.Path(row);
+    size_t lastSlash = path.find_last_of(L"\\/");
+    if (lastSlash == std::wstring::npos) return L""; // Root
+    return NormalizePath(path.substr(0, lastSlash).c_str());
 }
 
 static void RebuildDirectoryIndex() {
     g_DirectoryIndex.clear();
-    for (auto& kv : g_FileIndex) {
-        std::wstring path = kv.second.relativePath;
-        std::replace(path.begin(), path.end(), L'/', L'\\');
-        
-        size_t lastSlash = path.find_last_of(L'\\');
-        std::wstring dir;
-        if (lastSlash != std::wstring::npos) {
-            dir = NormalizePath(path.substr(0, lastSlash).c_str());
-        } else {
-            dir = L""; // Root
-        }
-        g_DirectoryIndex[dir].push_back(&kv.second);
+    for (DWORD row = 0; row < g_FileIndex.Size(); row++) {
+        if (!g_FileIndex.IsRemoved(row)) g_DirectoryIndex[DirectoryKey(row)].push_back(row);
+    }
+}
+
+// Sized for the index at startup; live reload adds paths in place.
+static void RebuildPathFilter() {
+    g_PathFilter.Reset(g_FileIndex.Size() + g_DirectoryIndex.size() + 1);
+    for (DWORD row = 0; row < g_FileIndex.Size(); row++) {
+        if (!g_FileIndex.IsRemoved(row)) g_PathFilter.AddPath(g_FileIndex.Path(row));
     }
+    // Searches of the game root itself name it as the last directory component
+    size_t lastSlash = g_GameRootDir.find_last_of(L'\\');
+    const wchar_t* root = g_GameRootDir.c_str() + (lastSlash == std::wstring::npos ? 0 : lastSlash + 1);
+    if (*root) g_PathFilter.AddName(HashComponent(root, root + wcslen(root)));
 }
 
-static bool DecompressData(const std::vector<BYTE>& input, DWORD decompressedSize, PBYTE output) {
+template <typename C> static bool IsAbsolutePath(const C* p) {
+    return (p[0] && p[1] == ':' && (p[2] == '\\' || p[2] == '/')) || (p[0] == '\\' && p[1] == '\\');
+}
+
+template <typename C> static ULONGLONG PathCacheKey(const C* path) {
+    size_t len = 0;
+    while (path[len]) len++;
+    return Utils::HashBytes(path, len * sizeof(C), sizeof(C)) | 1;
+}
+
+// Checks the per-thread cache for the caller's path and remembers its key, so a lookup that
+// follows can record or reuse the row. False means the path is known not to be virtual.
+static bool QueryPathCache(ULONGLONG key, bool absolute) {
+    const PathCacheSlot& slot = t_PathCache[key % kPathCacheSlots];
+    if (slot.hash == key && slot.generation == g_IndexGeneration && slot.row == FileIndex::kNone) return false;
+    t_QueryKey = absolute ? key : 0;
+    return true;
+}
+
+// Row the path last given to MayBeVirtual(A) resolved to on this thread, or kNone. Under g_Mutex,
+// which every generation change also holds.
+static DWORD CachedQueryRow() {
+    const PathCacheSlot& slot = t_PathCache[t_QueryKey % kPathCacheSlots];
+    if (!t_QueryKey || slot.hash != t_QueryKey || slot.generation != g_IndexGeneration || slot.row >= g_FileIndex.Size()) return FileIndex::kNone;
+    return slot.row;
+}
+
+static void NoteQueryRow(DWORD row) {
+    if (t_QueryKey) t_PathCache[t_QueryKey % kPathCacheSlots] = { t_QueryKey, g_IndexGeneration, row };
+    t_QueryKey = 0;
+}
+
+static bool DecompressData(const BYTE* input, SIZE_T inputSize, DWORD decompressedSize, PBYTE output) {
     ScopedDecompressor decompressor;
     if (!CreateDecompressor(COMPRESS_ALGORITHM_LZMS, NULL, (PDECOMPRESSOR_HANDLE)&decompressor.h)) return false;
 
     SIZE_T actualDecompressedSize = 0;
-    return Decompress(decompressor, input.data(), input.size(), output, decompressedSize, &actualDecompressedSize) 
+    return Decompress(decompressor, input, inputSize, output, decompressedSize, &actualDecompressedSize) 
            && (actualDecompressedSize == decompressedSize);
 }
 
-static void ScanLooseFiles(const wchar_t* basePath, const wchar_t* currentPath, const wchar_t* relativeBase) {
-    wchar_t searchPath[MAX_PATH];
-    wcscpy_s(searchPath, currentPath);
-    PathAppendW(searchPath, L"*");
+static void UnmapArchive() {
+    if (g_ArchiveMap.view) UnmapViewOfFile(g_ArchiveMap.view);
+    if (g_ArchiveMap.hMapping && g_RawCloseHandle) g_RawCloseHandle(g_ArchiveMap.hMapping);
+    g_ArchiveMap = ArchiveMapping();
+}
+
+static bool MapArchive(HANDLE hArchive) {
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(hArchive, &size) || size.QuadPart == 0) return false;
+
+    SYSTEM_INFO si; GetSystemInfo(&si);
+    g_ArchiveMap.granularity = si.dwAllocationGranularity;
+    g_ArchiveMap.pageSize = si.dwPageSize;
+    g_ArchiveMap.fileSize = size.QuadPart;
+    g_ArchiveMap.hMapping = CreateFileMappingW(hArchive, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!g_ArchiveMap.hMapping) { g_ArchiveMap = ArchiveMapping(); return false; }
+
+    if (kArchiveWindowSize == 0) {
+        g_ArchiveMap.view = (const BYTE*)MapViewOfFile(g_ArchiveMap.hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (!g_ArchiveMap.view) { UnmapArchive(); return false; }
+        g_ArchiveMap.viewOffset = 0;
+        g_ArchiveMap.viewSize = (SIZE_T)size.QuadPart;
+    }
+    return true;
+}
+
+// Returns a pointer to [offset, offset + size) inside the mapped archive, or nullptr
+// when the archive is not mapped. Must be called under g_Mutex; on x86 the pointer
+// stays valid only until the next call because the window may slide.
+static const BYTE* MapArchiveRange(LONGLONG offset, DWORD size) {
+    if (!g_ArchiveMap.hMapping || offset < 0 || offset + size > g_ArchiveMap.fileSize) return nullptr;
+    if (g_ArchiveMap.view && offset >= g_ArchiveMap.viewOffset &&
+        offset + size <= g_ArchiveMap.viewOffset + (LONGLONG)g_ArchiveMap.viewSize) {
+        return g_ArchiveMap.view + (offset - g_ArchiveMap.viewOffset);
+    }
+    if (kArchiveWindowSize == 0) return nullptr;
+
+    LONGLONG base = offset - (offset % g_ArchiveMap.granularity);
+    LONGLONG length = max((LONGLONG)kArchiveWindowSize, offset + size - base);
+    length = min(length, g_ArchiveMap.fileSize - base);
+
+    if (g_ArchiveMap.view) { UnmapViewOfFile(g_ArchiveMap.view); g_ArchiveMap.view = nullptr; }
+    g_ArchiveMap.view = (const BYTE*)MapViewOfFile(g_ArchiveMap.hMapping, FILE_MAP_READ,
+        (DWORD)(base >> 32), (DWORD)(base & 0xFFFFFFFF), (SIZE_T)length);
+    if (!g_ArchiveMap.view) return nullptr;
+    g_ArchiveMap.viewOffset = base;
+    g_ArchiveMap.viewSize = (SIZE_T)length;
+    return g_ArchiveMap.view + (offset - base);
+}
+
+static void DecryptArchiveBytes(LONGLONG offset, void* data, size_t size) {
+    if (g_ArchiveEncrypted) Cipher::Apply(g_ArchiveKey, (ULONGLONG)offset, (BYTE*)data, size);
+}
+
+// Reads the bytes as stored, still encrypted in an encrypted archive.
+static bool ReadArchiveRange(LONGLONG offset, DWORD size, std::vector<BYTE>& out) {
+    if (g_ArchiveHandle == INVALID_HANDLE_VALUE) return false;
+    out.resize(size);
+    LARGE_INTEGER s; s.QuadPart = offset;
+    DWORD br = 0;
+    return g_RawSetFilePointerEx(g_ArchiveHandle, s, NULL, FILE_BEGIN)
+        && g_RawReadFile(g_ArchiveHandle, out.data(), size, &br, NULL) && br == size;
+}
+
+static bool CopyArchiveRange(LONGLONG offset, void* dst, DWORD size) {
+    const BYTE* src = MapArchiveRange(offset, size);
+    if (src) {
+        memcpy(dst, src, size);
+    } else {
+        if (g_ArchiveHandle == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER s; s.QuadPart = offset;
+        DWORD br = 0;
+        if (!g_RawSetFilePointerEx(g_ArchiveHandle, s, NULL, FILE_BEGIN) ||
+            !g_RawReadFile(g_ArchiveHandle, dst, size, &br, NULL) || br != size) return false;
+    }
+    DecryptArchiveBytes(offset, dst, size);
+    return true;
+}
+
+// Returns the decrypted bytes at [offset, offset + size): straight from the mapping for a
+// plain archive, otherwise copied into buffer. Same locking rules as MapArchiveRange.
+static const BYTE* ReadArchiveBytes(LONGLONG offset, DWORD size, std::vector<BYTE>& buffer) {
+    const BYTE* src = g_ArchiveEncrypted ? nullptr : MapArchiveRange(offset, size);
+    if (src) return src;
+    buffer.resize(size);
+    return CopyArchiveRange(offset, buffer.data(), size) ? buffer.data() : nullptr;
+}
 
-    WIN32_FIND_DATAW fd;
-    HANDLE hFind = FindFirstFileW(searchPath, &fd);
-    if (hFind == INVALID_HANDLE_VALUE) return;
+// Parses the chunk table of a chunked entry. Returns false for plain LZMS or stored entries.
+static bool ReadChunkTable(const VFS::VirtualFileEntry& e, VFS::ChunkStream& cs) {
+    if (e.isLooseFile || e.size >= e.decompressedSize || e.size < 3 * sizeof(DWORD)) return false;
+    DWORD header[3];
+    if (!CopyArchiveRange(e.offset, header, sizeof(header))) return false;
+    if (header[0] != kChunkedMagic || header[1] == 0) return false;
+
+    // Exactly as many chunks as the size needs: ChunkLength assumes only the last is short
+    DWORD count = header[2];
+    LONGLONG tableEnd = (LONGLONG)(3 + (ULONGLONG)count) * sizeof(DWORD);
+    if (count != (DWORD)(((ULONGLONG)e.decompressedSize + header[1] - 1) / header[1]) || tableEnd > e.size) return false;
+
+    std::vector<DWORD> packedSizes(count);
+    if (count && !CopyArchiveRange(e.offset + sizeof(header), packedSizes.data(), count * sizeof(DWORD))) return false;
+
+    cs.chunkOffsets.resize(count + 1);
+    LONGLONG pos = e.offset + tableEnd, end = e.offset + e.size;
+    for (DWORD i = 0; i < count; i++) {
+        if (packedSizes[i] > end - pos) return false;
+        cs.chunkOffsets[i] = pos; pos += packedSizes[i];
+    }
+    cs.chunkOffsets[count] = pos;
+    cs.chunkSize = header[1];
+    return true;
+}
 
-    do {
-        if (wcscmp(fd.cFileName, L".") == 0 || wcscmp(fd.cFileName, L"..") == 0) continue;
+static DWORD ChunkLength(const VFS::VirtualFileEntry& e, const VFS::ChunkStream& cs, DWORD index) {
+    LONGLONG begin = (LONGLONG)index * cs.chunkSize;
+    return (DWORD)min((LONGLONG)cs.chunkSize, (LONGLONG)e.decompressedSize - begin);
+}
 
-        wchar_t fullPath[MAX_PATH];
-        wcscpy_s(fullPath, currentPath);
-        PathAppendW(fullPath, fd.cFileName);
+static bool DecodeChunk(const VFS::VirtualFileEntry& e, const VFS::ChunkStream& cs, DWORD index, PBYTE dst) {
+    DWORD len = ChunkLength(e, cs, index);
+    DWORD packed = (DWORD)(cs.chunkOffsets[index + 1] - cs.chunkOffsets[index]);
+    if (packed == len) return CopyArchiveRange(cs.chunkOffsets[index], dst, len);
 
-        wchar_t relativePath[MAX_PATH];
-        if (relativeBase[0] == L'\0') wcscpy_s(relativePath, fd.cFileName);
-        else {
-            wcscpy_s(relativePath, relativeBase);
-            PathAppendW(relativePath, fd.cFileName);
+    std::vector<BYTE> comp;
+    const BYTE* src = ReadArchiveBytes(cs.chunkOffsets[index], packed, comp);
+    return src && DecompressData(src, packed, len, dst);
+}
+
+// Decodes a whole entry (plain or chunked LZMS, or stored in an encrypted archive) into a
+// buffer of decompressedSize bytes.
+static bool DecodeEntry(const VFS::VirtualFileEntry& e, PBYTE out) {
+    if (e.size == e.decompressedSize) return CopyArchiveRange(e.offset, out, e.size);
+    VFS::ChunkStream cs;
+    if (ReadChunkTable(e, cs)) {
+        for (DWORD i = 0; i + 1 < cs.chunkOffsets.size(); i++) {
+            if (!DecodeChunk(e, cs, i, out + (size_t)i * cs.chunkSize)) return false;
         }
+        return true;
+    }
+    std::vector<BYTE> comp;
+    const BYTE* src = ReadArchiveBytes(e.offset, e.size, comp);
+    return src && DecompressData(src, e.size, e.decompressedSize, out);
+}
 
-        if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-            ScanLooseFiles(basePath, fullPath, relativePath);
-        } else {
-            VFS::VirtualFileEntry entry;
-            entry.relativePath = relativePath;
-            entry.offset = 0;
-            entry.size = fd.nFileSizeLow;
-            entry.decompressedSize = fd.nFileSizeLow;
-            entry.isLooseFile = true;
-            entry.looseFilePath = fullPath;
+// Returns [offset, offset + size) of the archive for use without g_Mutex held: a pointer
+// into the mapping when the whole file is mapped, otherwise a copy made under the lock.
+// Encrypted archives always get a copy, decrypted after the lock is released.
+static const BYTE* AcquireArchiveBytes(LONGLONG offset, DWORD size, std::vector<BYTE>& copy) {
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+        const BYTE* src = MapArchiveRange(offset, size);
+        if (src && kArchiveWindowSize == 0 && !g_ArchiveEncrypted) return src;
+        copy.resize(size);
+        if (src) memcpy(copy.data(), src, size);
+        else if (!ReadArchiveRange(offset, size, copy)) return nullptr;
+    }
+    DecryptArchiveBytes(offset, copy.data(), size);
+    return copy.data();
+}
 
-            g_FileIndex[NormalizePath(relativePath)] = entry;
+// Writes the decoded entry to hDest. Decoding and file writes run without g_Mutex.
+static bool ExtractEntryUnlocked(const VFS::VirtualFileEntry& e, HANDLE hDest) {
+    std::vector<BYTE> copy, out;
+    DWORD bw = 0;
+
+    if (e.size < e.decompressedSize) {
+        VFS::ChunkStream cs;
+        bool chunked;
+        { std::lock_guard<std::recursive_mutex> lock(g_Mutex); chunked = ReadChunkTable(e, cs); }
+        if (chunked) {
+            for (DWORD i = 0; i + 1 < cs.chunkOffsets.size(); i++) {
+                DWORD len = ChunkLength(e, cs, i);
+                DWORD packed = (DWORD)(cs.chunkOffsets[i + 1] - cs.chunkOffsets[i]);
+                const BYTE* src = AcquireArchiveBytes(cs.chunkOffsets[i], packed, copy);
+                if (!src) return false;
+                if (packed != len) {
+                    out.resize(len);
+                    if (!DecompressData(src, packed, len, out.data())) return false;
+                    src = out.data();
+                }
+                if (!WriteFile(hDest, src, len, &bw, NULL) || bw != len) return false;
+            }
+            return true;
         }
-    } while (FindNextFileW(hFind, &fd));
-    FindClose(hFind);
+        const BYTE* src = AcquireArchiveBytes(e.offset, e.size, copy);
+        out.resize(e.decompressedSize);
+        if (!src || !DecompressData(src, e.size, e.decompressedSize, out.data())) return false;
+        return WriteFile(hDest, out.data(), e.decompressedSize, &bw, NULL) && bw == e.decompressedSize;
+    }
+
+    for (DWORD done = 0; done < e.size; done += bw) {
+        DWORD len = min(kExtractBlockSize, e.size - done);
+        const BYTE* src = AcquireArchiveBytes(e.offset + done, len, copy);
+        if (!src || !WriteFile(hDest, src, len, &bw, NULL) || bw != len) return false;
+    }
+    return true;
 }
 
-namespace VFS {
-    bool Initialize(HMODULE hModule) {
+static void DropMemoryFile(std::unordered_map<ULONGLONG, MemoryFile>::iterator it) {
+    g_RawCloseHandle(it->second.file);
+    g_MemoryFileBytes -= it->second.size;
+    g_MemoryLru.erase(it->second.lruPos);
+    g_MemoryFiles.erase(it);
+}
+
+static void EvictMemoryFiles(size_t budget) {
+    while (g_MemoryFileBytes > budget && !g_MemoryLru.empty()) DropMemoryFile(g_MemoryFiles.find(g_MemoryLru.back()));
+}
+
+static void ClearMemoryFiles() {
+    for (auto& kv : g_MemoryFiles) g_RawCloseHandle(kv.second.file);
+    g_MemoryFiles.clear();
+    g_MemoryLru.clear();
+    g_MemoryFileBytes = 0;
+}
+
+// Entries that fit the budget go to a memory file; the rest fall back to the disk cache.
+static bool FitsMemoryFiles(const VFS::VirtualFileEntry& e) {
+    return e.decompressedSize <= g_MemoryFileBudget;
+}
+
+// Opens a read-only handle to the memory file for key, if there is one; path receives its name.
+static HANDLE OpenMemoryFile(ULONGLONG key, wchar_t* path) {
+    auto it = g_MemoryFiles.find(key);
+    if (it == g_MemoryFiles.end()) return INVALID_HANDLE_VALUE;
+    wcscpy_s(path, MAX_PATH, it->second.path.c_str());
+    g_MemoryLru.splice(g_MemoryLru.begin(), g_MemoryLru, it->second.lruPos);
+    // Delete-on-close files only open again with FILE_SHARE_DELETE
+    return g_RawCreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+}
+
+static bool ExtractToMemoryFile(ExtractJob* job, HANDLE& hFile) {
+    ExtractCache::GetMemoryPath(job->key, (DWORD)InterlockedIncrement(&g_MemoryFileSequence), job->path);
+    hFile = g_RawCreateFileW(job->path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (hFile == INVALID_HANDLE_VALUE) return false;
+    if (ExtractEntryUnlocked(job->entry, hFile)) return true;
+    g_RawCloseHandle(hFile);
+    hFile = INVALID_HANDLE_VALUE;
+    return false;
+}
+
+static bool ExtractToDiskCache(ExtractJob* job) {
+    wchar_t staging[MAX_PATH];
+    ExtractCache::GetStagingPath(job->key, staging);
+    bool written;
+    {
+        ScopedRawHandle hDest(g_RawCreateFileW(staging, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+        written = hDest != INVALID_HANDLE_VALUE && ExtractEntryUnlocked(job->entry, hDest);
+    }
+    if (written) return ExtractCache::Commit(job->key, staging, job->path);
+    DeleteFileW(staging);
+    return false;
+}
+
+static DWORD WINAPI ExtractWorker(LPVOID param) {
+    std::unique_ptr<std::shared_ptr<ExtractJob>> holder((std::shared_ptr<ExtractJob>*)param);
+    ExtractJob* job = holder->get();
+
+    ULONGLONG start = GetTickCount64();
+    ULONGLONG extractStart = Metrics::Now(), traceStart = Trace::Now();
+    HANDLE hMemory = INVALID_HANDLE_VALUE;
+    job->succeeded = job->inMemory ? ExtractToMemoryFile(job, hMemory) : ExtractToDiskCache(job);
+    Trace::Record(Trace::EXTRACT, job->entry.index, job->entry.decompressedSize, traceStart);
+    Metrics::Add(job->entry.index, Metrics::EXTRACTIONS);
+    Metrics::Add(job->entry.index, Metrics::EXTRACT_US, Metrics::Now() - extractStart);
+
+    {
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        if (g_IsActive) return true;
+        if (hMemory != INVALID_HANDLE_VALUE) {
+            // Replaces a previous file for the key that could no longer be reopened
+            auto previous = g_MemoryFiles.find(job->key);
+            if (previous != g_MemoryFiles.end()) DropMemoryFile(previous);
+            EvictMemoryFiles(g_MemoryFileBudget - job->entry.decompressedSize);
+            g_MemoryLru.push_front(job->key);
+            g_MemoryFiles[job->key] = { hMemory, job->entry.decompressedSize, job->path, g_MemoryLru.begin() };
+            g_MemoryFileBytes += job->entry.decompressedSize;
+        }
+        if (Config::EnableDebug) {
+            Utils::LogW(L"[VFS-Extract] %s %s in %llu ms%s", g_FileIndex.Path(job->entry.index),
+                job->succeeded ? L"extracted" : L"failed", GetTickCount64() - start,
+                job->inMemory ? L" (memory file)" : L"");
+            if (hMemory != INVALID_HANDLE_VALUE) {
+                Utils::Log("[VFS-Extract] Memory files: %zu, %zu KB of %zu KB", g_MemoryFiles.size(),
+                    g_MemoryFileBytes / 1024, g_MemoryFileBudget / 1024);
+            }
+        }
+        g_ExtractJobs.erase(job->key);
+    }
+    SetEvent(job->done);
+    return 0;
+}
 
-        g_RawReadFile = (pReadFile)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "ReadFile");
-        g_RawSetFilePointerEx = (pSetFilePointerEx)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetFilePointerEx");
-        g_RawCloseHandle = (pCloseHandle)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "CloseHandle");
-        g_RawCreateFileW = (pCreateFileW)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "CreateFileW");
+// Returns the pending job for key, starting one on the thread pool if none is running.
+static std::shared_ptr<ExtractJob> QueueExtraction(ULONGLONG key, const VFS::VirtualFileEntry& entry, bool inMemory) {
+    auto pending = g_ExtractJobs.find(key);
+    if (pending != g_ExtractJobs.end()) return pending->second;
+
+    auto job = std::make_shared<ExtractJob>();
+    job->key = key;
+    job->entry = entry;
+    job->inMemory = inMemory;
+    if (!job->done) return nullptr;
+    auto* param = new std::shared_ptr<ExtractJob>(job);
+    if (!QueueUserWorkItem(ExtractWorker, param, WT_EXECUTELONGFUNCTION)) {
+        delete param;
+        return nullptr;
+    }
+    g_ExtractJobs[key] = job;
+    return job;
+}
+
+// Extraction cache key: archive identity plus the entry's path and location. The header
+// index alone doesn't cover the payload, so a repacked archive with the same layout is
+// told apart by its write time.
+static ULONGLONG ExtractCacheKey(const VFS::VirtualFileEntry& e) {
+    ULONGLONG key = Utils::HashBytes(&g_ArchiveWriteTime, sizeof(g_ArchiveWriteTime), g_ArchiveId);
+    for (const wchar_t* p = g_FileIndex.Path(e.index); *p; ++p) {
+        wchar_t c = FoldPathChar(*p); // same bytes as hashing the normalized path
+        key = Utils::HashBytes(&c, sizeof(c), key);
+    }
+    key = Utils::HashBytes(&e.offset, sizeof(e.offset), key);
+    key = Utils::HashBytes(&e.size, sizeof(e.size), key);
+    return Utils::HashBytes(&e.decompressedSize, sizeof(e.decompressedSize), key);
+}
+
+// Background pass over [FileHook] PreExtract, one entry at a time so it never
+// competes with on-demand extraction for more than a single worker.
+static DWORD WINAPI PreExtractWorker(LPVOID) {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+    std::vector<std::wstring> patterns;
+    std::wstring spec = Config::VFSPreExtract;
+    size_t start = 0, end;
+    while ((end = spec.find(L'|', start)) != std::wstring::npos) {
+        if (end > start) patterns.push_back(NormalizePath(spec.substr(start, end - start).c_str()));
+        start = end + 1;
+    }
+    if (start < spec.length()) patterns.push_back(NormalizePath(spec.substr(start).c_str()));
+
+    std::vector<std::pair<ULONGLONG, VFS::VirtualFileEntry>> targets;
+    {
+        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+        for (DWORD row = 0; row < g_FileIndex.Size(); row++) {
+            if (g_FileIndex.IsLoose(row) || g_FileIndex.IsRemoved(row)) continue;
+            std::wstring norm = NormalizePath(g_FileIndex.Path(row));
+            for (const auto& pattern : patterns) {
+                if (PathMatchSpecW(norm.c_str(), pattern.c_str())) {
+                    VFS::VirtualFileEntry e = g_FileIndex.Entry(row);
+                    targets.push_back({ ExtractCacheKey(e), e });
+                    break;
+                }
+            }
+        }
+    }
+
+    size_t extracted = 0;
+    for (const auto& target : targets) {
+        wchar_t cPath[MAX_PATH];
+        if (ExtractCache::Lookup(target.first, cPath)) continue;
+        std::shared_ptr<ExtractJob> job;
+        {
+            std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+            if (!g_IsActive) break;
+            job = QueueExtraction(target.first, target.second, false);
+        }
+        if (!job) continue;
+        WaitForSingleObject(job->done, INFINITE);
+        if (job->succeeded) extracted++;
+    }
+    Utils::Log("[VFS-Extract] Pre-extracted %zu of %zu matching entries", extracted, targets.size());
+    return 0;
+}
+
+static void GrowRowPolicy(DWORD row) {
+    if (row < g_RowUsage.size()) return;
+    g_RowUsage.resize(max((size_t)row + 1, (size_t)g_FileIndex.Size()));
+    g_RowLogged.resize(g_RowUsage.size());
+}
+
+// Automatic mode: whether this open gets a real handle to an extracted copy.
+static bool ChooseRealHandle(DWORD row, const VFS::VirtualFileEntry& e) {
+    if (e.isLooseFile) return true; // the file itself, nothing to extract
+    GrowRowPolicy(row);
+    ServePolicy::Decision d = ServePolicy::Choose(g_FileIndex.Path(row), e.decompressedSize, g_RowUsage[row]);
+    BYTE logged = (BYTE)(d.strategy + 1);
+    if (g_RowLogged[row] != logged) {
+        g_RowLogged[row] = logged;
+        // Learned switches always matter; the per-entry defaults only when debugging
+        if (Config::EnableDebug || g_RowUsage[row]) {
+            Utils::LogW(L"[VFS-Policy] %s: %s (%S)", g_FileIndex.Path(row),
+                d.strategy == ServePolicy::REAL ? L"real handle" : L"emulated handle", d.reason);
+        }
+    }
+    return d.strategy == ServePolicy::REAL;
+}
+
+static void NoteRowUsage(DWORD row, BYTE usage, const char* api) {
+    if (Config::VFSMode != 2) return;
+    GrowRowPolicy(row);
+    if (g_RowUsage[row] & usage) return;
+    g_RowUsage[row] |= usage;
+    Utils::LogW(L"[VFS-Policy] %s: emulated handle passed to %S, later opens get a real handle", g_FileIndex.Path(row), api);
+}
+
+static void FillFileInfo(const VFS::VirtualFileEntry& e, VFS::VirtualFileInfo* info) {
+    info->attributes = FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_READONLY;
+    info->size = e.decompressedSize;
+    info->creationTime = info->lastAccessTime = info->lastWriteTime = e.lastWriteTime;
+}
+
+static void EvictDecoded(size_t budget) {
+    while (g_DecodedCacheBytes > budget && !g_DecodedLru.empty()) {
+        auto it = g_DecodedCache.find(g_DecodedLru.back());
+        g_DecodedCacheBytes -= it->second.data->size();
+        g_DecodedCache.erase(it);
+        g_DecodedLru.pop_back();
+    }
+}
+
+static void ClearDecodedCache() {
+    g_DecodedCache.clear();
+    g_DecodedLru.clear();
+    g_DecodedCacheBytes = 0;
+}
+
+static void InvalidateDecoded(DWORD row) {
+    auto it = g_DecodedCache.find(row);
+    if (it == g_DecodedCache.end()) return;
+    g_DecodedCacheBytes -= it->second.data->size();
+    g_DecodedLru.erase(it->second.lruPos);
+    g_DecodedCache.erase(it);
+}
+
+// Returns the decompressed payload of an archive entry, decoding it on a cache miss.
+static void InsertDecoded(DWORD row, const DecodedBuffer& decoded, bool prefetched) {
+    if (decoded->size() > g_DecodedCacheBudget || g_DecodedCache.count(row)) return;
+    EvictDecoded(g_DecodedCacheBudget - decoded->size());
+    g_DecodedLru.push_front(row);
+    g_DecodedCache[row] = { decoded, g_DecodedLru.begin(), prefetched };
+    g_DecodedCacheBytes += decoded->size();
+}
+
+static DecodedBuffer GetDecodedEntry(const VFS::VirtualFileEntry& entry) {
+    auto hit = g_DecodedCache.find(entry.index);
+    if (hit != g_DecodedCache.end()) {
+        g_DecodedCacheHits++;
+        Metrics::Add(entry.index, Metrics::CACHE_HITS);
+        if (hit->second.prefetched) { hit->second.prefetched = false; g_PrefetchUsed++; }
+        g_DecodedLru.splice(g_DecodedLru.begin(), g_DecodedLru, hit->second.lruPos);
+        return hit->second.data;
+    }
+    g_DecodedCacheMisses++;
+    Metrics::Add(entry.index, Metrics::CACHE_MISSES);
+
+    auto decoded = std::make_shared<std::vector<BYTE>>(entry.decompressedSize);
+    ULONGLONG decodeStart = Metrics::Now(), traceStart = Trace::Now();
+    if (!DecodeEntry(entry, decoded->data())) return nullptr;
+    Trace::Record(Trace::DECODE, entry.index, entry.decompressedSize, traceStart);
+    Metrics::Add(entry.index, Metrics::DECODES);
+    Metrics::Add(entry.index, Metrics::DECODE_US, Metrics::Now() - decodeStart);
+    InsertDecoded(entry.index, decoded, false);
+    return decoded;
+}
+
+// Stored entries of an encrypted archive go through the decoded cache too, so the keystream
+// is applied once per entry instead of on every read.
+static bool UsesDecodedCache(const VFS::VirtualFileEntry& e) {
+    return e.size < e.decompressedSize || (g_ArchiveEncrypted && e.decompressedSize <= g_DecodedCacheBudget);
+}
+
+static bool IsPrefetchCandidate(DWORD row) {
+    if (row == FileIndex::kNone || g_FileIndex.IsLoose(row)) return false;
+    VFS::VirtualFileEntry e = g_FileIndex.Entry(row);
+    return UsesDecodedCache(e) && e.decompressedSize <= g_DecodedCacheBudget / 4 && !g_DecodedCache.count(row);
+}
+
+static void QueuePrefetch(DWORD row) {
+    if (!IsPrefetchCandidate(row)) return;
+    if (std::find(g_PrefetchQueue.begin(), g_PrefetchQueue.end(), row) != g_PrefetchQueue.end()) return;
+    if (g_PrefetchQueue.size() >= kPrefetchQueueLimit) g_PrefetchQueue.pop_front();
+    g_PrefetchQueue.push_back(row);
+}
+
+// Records an open and queues the entries most likely to be opened next:
+// the numbered successors of the file name (voice_0001 -> voice_0002) and whatever
+// followed this entry the last time it was opened.
+static void NotePrefetchAccess(DWORD row) {
+    if (!g_PrefetchThread) return;
+    if (g_LastOpened != FileIndex::kNone && g_LastOpened != row) g_AccessSuccessor[g_LastOpened] = row;
+    g_LastOpened = row;
+
+    const wchar_t* path = g_FileIndex.Path(row);
+    size_t length = wcslen(path);
+    const wchar_t* name = PathFindFileNameW(path);
+    const wchar_t* dot = wcsrchr(name, L'.');
+    size_t nameStart = name - path;
+    size_t digitsEnd = dot ? (size_t)(dot - path) : length;
+    size_t digitsStart = digitsEnd;
+    while (digitsStart > nameStart && iswdigit(path[digitsStart - 1])) digitsStart--;
+
+    size_t width = digitsEnd - digitsStart;
+    if (width > 0 && width <= 9 && length < MAX_PATH) {
+        wchar_t next[MAX_PATH];
+        wmemcpy(next, path, length + 1);
+        ULONG number = wcstoul(path + digitsStart, nullptr, 10);
+        for (int i = 1; i <= kPrefetchSequenceDepth; i++) {
+            wchar_t digits[16];
+            swprintf_s(digits, L"%0*lu", (int)width, number + i);
+            if (wcslen(digits) != width) break;
+            wmemcpy(next + digitsStart, digits, width);
+            QueuePrefetch(g_FileIndex.Find(next));
+        }
+    }
 
-        if (!g_RawReadFile || !g_RawSetFilePointerEx || !g_RawCloseHandle || !g_RawCreateFileW) return false;
-        if (!Config::EnableFileHook) return false;
+    auto succ = g_AccessSuccessor.find(row);
+    if (succ != g_AccessSuccessor.end()) QueuePrefetch(succ->second);
+    if (!g_PrefetchQueue.empty()) SetEvent(g_PrefetchEvent);
+}
 
-        // Setup paths
-        wchar_t baseDir[MAX_PATH];
-        GetModuleFileNameW(hModule, baseDir, MAX_PATH);
-        PathRemoveFileSpecW(baseDir);
+static DWORD WINAPI PrefetchWorker(LPVOID) {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+    while (WaitForSingleObject(g_PrefetchEvent, INFINITE) == WAIT_OBJECT_0 && !g_PrefetchStop) {
+        for (;;) {
+            VFS::VirtualFileEntry e;
+            std::vector<BYTE> comp;
+            {
+                // Only the copy of the packed bytes happens under the lock; decoding does not
+                std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+                if (g_PrefetchStop || g_PrefetchQueue.empty()) break;
+                DWORD row = g_PrefetchQueue.front();
+                g_PrefetchQueue.pop_front();
+                if (!IsPrefetchCandidate(row)) continue;
+                e = g_FileIndex.Entry(row);
+                VFS::ChunkStream cs;
+                if (ReadChunkTable(e, cs)) continue; // chunked entries stream on demand
+                comp.resize(e.size);
+                if (!CopyArchiveRange(e.offset, comp.data(), e.size)) continue;
+            }
+            std::shared_ptr<std::vector<BYTE>> decoded;
+            ULONGLONG decodeStart = Metrics::Now(), traceStart = Trace::Now();
+            if (e.size == e.decompressedSize) {
+                decoded = std::make_shared<std::vector<BYTE>>(std::move(comp)); // stored, decrypted by the copy
+            } else {
+                decoded = std::make_shared<std::vector<BYTE>>(e.decompressedSize);
+                if (!DecompressData(comp.data(), comp.size(), e.decompressedSize, decoded->data())) continue;
+            }
+            Trace::Record(Trace::DECODE, e.index, e.decompressedSize, traceStart);
+            Metrics::Add(e.index, Metrics::DECODES);
+            Metrics::Add(e.index, Metrics::DECODE_US, Metrics::Now() - decodeStart);
 
-        if (Config::VFSMode == 0) { // Modern mode cache
-            GetTempPathW(MAX_PATH, g_HybridCacheDir);
-            PathAppendW(g_HybridCacheDir, L"VFS_CHS_Cache");
-            if (!PathIsDirectoryW(g_HybridCacheDir)) CreateDirectoryW(g_HybridCacheDir, NULL);
+            std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+            if (g_PrefetchStop) break;
+            if (!g_DecodedCache.count(e.index)) { InsertDecoded(e.index, decoded, true); g_PrefetchDecoded++; }
         }
+    }
+    return 0;
+}
+
+static void StartPrefetch() {
+    if (!Config::VFSPrefetch || Config::VFSMode == 0 || g_DecodedCacheBudget == 0 || g_ArchiveHandle == INVALID_HANDLE_VALUE) return;
+    g_PrefetchStop = false;
+    g_PrefetchEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    if (!g_PrefetchEvent) return;
+    g_PrefetchThread = CreateThread(NULL, 0, PrefetchWorker, NULL, 0, NULL);
+    if (!g_PrefetchThread) { CloseHandle(g_PrefetchEvent); g_PrefetchEvent = NULL; }
+}
+
+// Called from DLL_PROCESS_DETACH, so the worker is signalled but never waited on.
+static void StopPrefetch() {
+    if (!g_PrefetchThread) return;
+    g_PrefetchStop = true;
+    SetEvent(g_PrefetchEvent);
+    CloseHandle(g_PrefetchThread);
+    g_PrefetchThread = NULL;
+    g_PrefetchQueue.clear();
+    g_AccessSuccessor.clear();
+    g_LastOpened = FileIndex::kNone;
+}
+
+// Copies row paths for the metrics dump. Only the copy holds g_Mutex; the JSON is built
+// and written after it is released.
+static void MetricsPaths(const std::vector<DWORD>& rows, std::vector<std::wstring>& paths) {
+    std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+    paths.reserve(rows.size());
+    for (DWORD row : rows) paths.push_back(row < g_FileIndex.Size() ? g_FileIndex.Path(row) : L"");
+}
+
+// Runs on the metrics watcher thread when a dump is requested.
+static void DumpMetrics() {
+    Metrics::WriteJson("request", MetricsPaths);
+}
+
+// Resolves rows for the trace, on the thread recording the event.
+static bool TracePath(DWORD row, wchar_t* path) {
+    std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+    if (row >= g_FileIndex.Size()) return false;
+    wcscpy_s(path, MAX_PATH, g_FileIndex.Path(row));
+    return true;
+}
+
+// Indexes the redirect folder. The scan manifest lives in the shared temp cache root,
+// one file per redirect folder.
+static void ScanLooseFiles(std::vector<LooseScan::LooseDirectory>* dirs) {
+    wchar_t manifest[MAX_PATH];
+    GetTempPathW(MAX_PATH, manifest);
+    PathAppendW(manifest, L"VFS_CHS_Cache");
+    bool haveManifest = PathIsDirectoryW(manifest) || CreateDirectoryW(manifest, NULL);
+    if (haveManifest) {
+        std::wstring folderKey = NormalizePath(g_LooseFolderPath);
+        wchar_t name[32];
+        swprintf_s(name, L"loose_%016llx.bin", Utils::HashBytes(folderKey.c_str(), folderKey.length() * sizeof(wchar_t)));
+        PathAppendW(manifest, name);
+    }
+
+    std::vector<LooseScan::LooseFile> files;
+    LooseScan::Scan(g_LooseFolderPath, haveManifest ? manifest : nullptr, files, dirs);
+    for (const auto& f : files) {
+        LONGLONG writeTime = ((LONGLONG)f.lastWriteTime.dwHighDateTime << 32) | f.lastWriteTime.dwLowDateTime;
+        g_FileIndex.Add(f.relativePath.c_str(), writeTime, f.size, f.size, FileIndex::kLooseFile);
+    }
+}
+
+// Applies a created or modified loose file. A loose file over an archive entry takes
+// its row, and the archive location is remembered for when the file goes away.
+static void ApplyLooseFile(const wchar_t* rel, DWORD size, const FILETIME& writeTime) {
+    DWORD row = g_FileIndex.Find(rel);
+    if (row == FileIndex::kNone) {
+        LONGLONG t = ((LONGLONG)writeTime.dwHighDateTime << 32) | writeTime.dwLowDateTime;
+        g_FileIndex.Add(rel, t, size, size, FileIndex::kLooseFile);
+        g_NarrowIndex.Sync(g_FileIndex);
+        g_PathFilter.AddPath(rel);
+        InterlockedIncrement(&g_IndexGeneration);
+        row = g_FileIndex.Find(rel);
+        auto& rows = g_DirectoryIndex[DirectoryKey(row)];
+        if (std::find(rows.begin(), rows.end(), row) == rows.end()) rows.push_back(row);
+        return;
+    }
+    if (!g_FileIndex.IsLoose(row)) {
+        VFS::VirtualFileEntry e = g_FileIndex.Entry(row);
+        g_ShadowedArchive[g_FileIndex.Path(row)] = { e.offset, e.size, e.decompressedSize };
+        InvalidateDecoded(row);
+    }
+    g_FileIndex.UpdateLoose(row, size, writeTime);
+    InterlockedIncrement(&g_IndexGeneration);
+}
+
+static void RemoveLooseRow(DWORD row) {
+    InterlockedIncrement(&g_IndexGeneration);
+    auto shadow = g_ShadowedArchive.find(g_FileIndex.Path(row));
+    if (shadow != g_ShadowedArchive.end()) {
+        g_FileIndex.Set(row, shadow->second.offset, shadow->second.size, shadow->second.decompressedSize, 0);
+        g_ShadowedArchive.erase(shadow);
+        return;
+    }
+    g_FileIndex.Remove(row);
+    auto dir = g_DirectoryIndex.find(DirectoryKey(row));
+    if (dir != g_DirectoryIndex.end()) dir->second.erase(std::remove(dir->second.begin(), dir->second.end(), row), dir->second.end());
+}
+
+// Removes a deleted file, or every loose file under a deleted or renamed directory.
+static void RemoveLoosePath(const wchar_t* rel) {
+    DWORD row = g_FileIndex.Find(rel);
+    if (row != FileIndex::kNone) {
+        if (g_FileIndex.IsLoose(row)) RemoveLooseRow(row);
+        return;
+    }
+    std::wstring prefix = NormalizePath(rel) + L"\\";
+    for (row = 0; row < g_FileIndex.Size(); row++) {
+        if (!g_FileIndex.IsLoose(row) || g_FileIndex.IsRemoved(row)) continue;
+        const wchar_t* p = SkipLeadingSeparators(g_FileIndex.Path(row));
+        size_t i = 0;
+        while (i < prefix.length() && p[i] && FoldPathChar(p[i]) == prefix[i]) i++;
+        if (i == prefix.length()) RemoveLooseRow(row);
+    }
+}
+
+struct LooseChange {
+    bool removed;
+    std::wstring relativePath;
+    DWORD size;
+    FILETIME lastWriteTime;
+};
+
+// Turns raw notifications into index changes. File system queries happen here,
+// before g_Mutex is taken, so lookups are only blocked while the changes are applied.
+static void CollectLooseChanges(const BYTE* buffer, std::vector<LooseChange>& changes) {
+    for (const BYTE* p = buffer;;) {
+        const FILE_NOTIFY_INFORMATION* fni = (const FILE_NOTIFY_INFORMATION*)p;
+        std::wstring rel(fni->FileName, fni->FileNameLength / sizeof(wchar_t));
+        wchar_t full[MAX_PATH];
+        wcscpy_s(full, g_LooseFolderPath);
+        WIN32_FILE_ATTRIBUTE_DATA attr;
+        bool gone = fni->Action == FILE_ACTION_REMOVED || fni->Action == FILE_ACTION_RENAMED_OLD_NAME
+            || !PathAppendW(full, rel.c_str()) || !GetFileAttributesExW(full, GetFileExInfoStandard, &attr);
+        if (gone) {
+            changes.push_back({ true, rel, 0, {} });
+        } else if (attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+            // A directory moved or copied in arrives as one event; its files are listed here
+            if (fni->Action != FILE_ACTION_MODIFIED) {
+                std::vector<LooseScan::LooseFile> files;
+                LooseScan::Scan(full, nullptr, files);
+                for (const auto& f : files) changes.push_back({ false, rel + L"\\" + f.relativePath, f.size, f.lastWriteTime });
+            }
+        } else {
+            changes.push_back({ false, rel, attr.nFileSizeLow, attr.ftLastWriteTime });
+        }
+        if (!fni->NextEntryOffset) break;
+        p += fni->NextEntryOffset;
+    }
+}
+
+// The notification buffer overflowed: compare the whole folder against the index.
+static void ResyncLooseFiles() {
+    std::vector<LooseScan::LooseFile> files;
+    LooseScan::Scan(g_LooseFolderPath, nullptr, files);
+    std::unordered_set<std::wstring, PathHash, PathEqual> present;
+    std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+    if (g_WatchStop) return;
+    for (const auto& f : files) {
+        ApplyLooseFile(f.relativePath.c_str(), f.size, f.lastWriteTime);
+        present.insert(f.relativePath);
+    }
+    for (DWORD row = 0; row < g_FileIndex.Size(); row++) {
+        if (g_FileIndex.IsLoose(row) && !g_FileIndex.IsRemoved(row) && !present.count(g_FileIndex.Path(row))) RemoveLooseRow(row);
+    }
+    Utils::Log("[VFS-Reload] Notification overflow, resynced %zu loose files", files.size());
+}
+
+static DWORD WINAPI WatchWorker(LPVOID) {
+    ScopedRawHandle hDir(g_RawCreateFileW(g_LooseFolderPath, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL));
+    if (hDir == INVALID_HANDLE_VALUE) return 0;
+    OVERLAPPED ov = {};
+    ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!ov.hEvent) return 0;
+
+    const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+    std::vector<DWORD> buffer(16 * 1024); // 64 KB, DWORD aligned as the API requires
+    HANDLE waits[2] = { g_WatchStopEvent, ov.hEvent };
+    while (!g_WatchStop) {
+        ResetEvent(ov.hEvent);
+        DWORD bytes = 0;
+        if (!ReadDirectoryChangesW(hDir, buffer.data(), (DWORD)(buffer.size() * sizeof(DWORD)), TRUE, filter, NULL, &ov, NULL)) break;
+        if (WaitForMultipleObjects(2, waits, FALSE, INFINITE) != WAIT_OBJECT_0 + 1) {
+            CancelIo(hDir);
+            GetOverlappedResult(hDir, &ov, &bytes, TRUE);
+            break;
+        }
+        if (!GetOverlappedResult(hDir, &ov, &bytes, FALSE)) break;
+        if (bytes == 0) { ResyncLooseFiles(); continue; }
+
+        std::vector<LooseChange> changes;
+        CollectLooseChanges((const BYTE*)buffer.data(), changes);
+        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+        if (g_WatchStop) break;
+        for (const auto& c : changes) {
+            if (c.removed) RemoveLoosePath(c.relativePath.c_str());
+            else ApplyLooseFile(c.relativePath.c_str(), c.size, c.lastWriteTime);
+            if (Config::EnableDebug) Utils::LogW(L"[VFS-Reload] %s %s", c.removed ? L"removed" : L"updated", c.relativePath.c_str());
+        }
+    }
+    CloseHandle(ov.hEvent);
+    return 0;
+}
+
+static void StartLiveReload() {
+    if (!Config::VFSLiveReload || !PathIsDirectoryW(g_LooseFolderPath)) return;
+    g_WatchStop = false;
+    g_WatchStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (!g_WatchStopEvent) return;
+    g_WatchThread = CreateThread(NULL, 0, WatchWorker, NULL, 0, NULL);
+    if (!g_WatchThread) { CloseHandle(g_WatchStopEvent); g_WatchStopEvent = NULL; }
+}
+
+// Same as StopPrefetch: signalled from DLL_PROCESS_DETACH, never waited on.
+static void StopLiveReload() {
+    if (!g_WatchThread) return;
+    g_WatchStop = true;
+    SetEvent(g_WatchStopEvent);
+    CloseHandle(g_WatchThread);
+    g_WatchThread = NULL;
+}
+
+// Reads the cipher header of an encrypted archive and derives its key from ArchiveKey.
+// Returns false when the archive cannot be decrypted; plain archives always succeed.
+static bool OpenArchiveCipher(HANDLE hArchive) {
+    g_ArchiveEncrypted = false;
+    g_ArchiveDataStart = 0;
+    Cipher::ArchiveHeader header = {};
+    DWORD br = 0;
+    bool hasHeader = g_RawReadFile(hArchive, &header, sizeof(header), &br, NULL) && br == sizeof(header) && header.magic == Cipher::kArchiveMagic;
+    LARGE_INTEGER zero = { 0 };
+    g_RawSetFilePointerEx(hArchive, zero, NULL, FILE_BEGIN);
+    if (!hasHeader) return true;
+
+    if (header.version != Cipher::kArchiveVersion) {
+        Utils::Log("[VFS] Archive cipher version %u is not supported", header.version);
+        return false;
+    }
+    char passphrase[256 * 3];
+    if (!Config::ArchiveKey[0] || !WideCharToMultiByte(CP_UTF8, 0, Config::ArchiveKey, -1, passphrase, sizeof(passphrase), NULL, NULL)) {
+        Utils::Log("[VFS] Archive is encrypted but [FileRedirect] ArchiveKey is not set");
+        return false;
+    }
+    Cipher::DeriveKey(passphrase, header.salt, g_ArchiveKey);
+    SecureZeroMemory(passphrase, sizeof(passphrase));
+    if (Cipher::KeyCheck(g_ArchiveKey) != header.keyCheck) {
+        Utils::Log("[VFS] ArchiveKey does not match the archive");
+        return false;
+    }
+    g_ArchiveEncrypted = true;
+    g_ArchiveDataStart = sizeof(header);
+    Utils::Log("[VFS] Archive is encrypted, using the %s cipher kernel", Cipher::KernelName());
+    return true;
+}
+
+static SnapshotSource DescribeSnapshotSource(HANDLE hArchive) {
+    SnapshotSource source = {};
+    std::wstring paths = NormalizePath(g_ArchivePath) + L"|" + NormalizePath(g_LooseFolderPath);
+    source.pathHash = Utils::HashBytes(paths.c_str(), paths.length() * sizeof(wchar_t));
+    source.archiveSize = -1;
+    LARGE_INTEGER size;
+    if (hArchive != INVALID_HANDLE_VALUE && GetFileSizeEx(hArchive, &size)) {
+        source.archiveSize = size.QuadPart;
+        source.archiveWriteTime = g_ArchiveWriteTime;
+        std::vector<BYTE> head((size_t)min((LONGLONG)kSnapshotHeadBytes, size.QuadPart));
+        DWORD br = 0;
+        if (!head.empty() && g_RawReadFile(hArchive, head.data(), (DWORD)head.size(), &br, NULL)) source.archiveHeadHash = Utils::HashBytes(head.data(), br);
+        LARGE_INTEGER zero = { 0 };
+        g_RawSetFilePointerEx(hArchive, zero, NULL, FILE_BEGIN);
+    }
+    return source;
+}
+
+// A file rewritten in place keeps its directory's write time, so the loose rows of a
+// snapshot are checked against one listing per directory: changed sizes and write times
+// are taken over, and a file the snapshot does not know (or a row with no file) rejects it.
+static bool RefreshLooseRows(FileIndex& index, const std::vector<std::wstring>& looseDirs) {
+    size_t seen = 0, refreshed = 0;
+    for (const std::wstring& rel : looseDirs) {
+        wchar_t pattern[MAX_PATH];
+        wcscpy_s(pattern, g_LooseFolderPath);
+        if ((!rel.empty() && !PathAppendW(pattern, rel.c_str())) || !PathAppendW(pattern, L"*")) return false;
+        WIN32_FIND_DATAW fd;
+        HANDLE hFind = FindFirstFileExW(pattern, FindExInfoBasic, &fd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+        if (hFind == INVALID_HANDLE_VALUE) return false;
+        bool ok = true;
+        do {
+            if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) continue;
+            std::wstring path = rel.empty() ? fd.cFileName : rel + L"\\" + fd.cFileName;
+            DWORD row = index.Find(path.c_str());
+            if (row == FileIndex::kNone || !index.IsLoose(row)) { ok = false; break; }
+            seen++;
+            VFS::VirtualFileEntry e = index.Entry(row);
+            if (e.size != fd.nFileSizeLow || CompareFileTime(&e.lastWriteTime, &fd.ftLastWriteTime) != 0) {
+                index.UpdateLoose(row, fd.nFileSizeLow, fd.ftLastWriteTime);
+                refreshed++;
+            }
+        } while (FindNextFileW(hFind, &fd));
+        FindClose(hFind);
+        if (!ok) return false;
+    }
+    size_t looseRows = 0;
+    for (DWORD row = 0; row < index.Size(); row++) if (index.IsLoose(row) && !index.IsRemoved(row)) looseRows++;
+    if (seen != looseRows) return false;
+    if (refreshed) Utils::Log("[VFS] Snapshot: %zu loose files changed in place", refreshed);
+    return true;
+}
+
+static bool ParseIndexSnapshot(const BYTE* data, size_t size, const SnapshotSource& source) {
+    SnapshotReader r = { data, data + size, true };
+    if (r.Pod<DWORD>() != kSnapshotMagic || r.Pod<DWORD>() != kSnapshotVersion) return false;
+    SnapshotSource saved = r.Pod<SnapshotSource>();
+    ULONGLONG archiveId = r.Pod<ULONGLONG>();
+    if (!r.ok || saved.pathHash != source.pathHash || saved.archiveSize != source.archiveSize ||
+        CompareFileTime(&saved.archiveWriteTime, &source.archiveWriteTime) != 0 || saved.archiveHeadHash != source.archiveHeadHash) return false;
+
+    // Adding, removing or renaming a loose file changes its directory's write time
+    DWORD dirCount = r.Pod<DWORD>();
+    if (!r.ok || (dirCount != 0) != (PathIsDirectoryW(g_LooseFolderPath) != FALSE)) return false;
+    std::vector<std::wstring> looseDirs;
+    for (DWORD i = 0; i < dirCount; i++) {
+        std::wstring rel = r.String();
+        ULONGLONG writeTime = r.Pod<ULONGLONG>();
+        wchar_t full[MAX_PATH];
+        wcscpy_s(full, g_LooseFolderPath);
+        WIN32_FILE_ATTRIBUTE_DATA attr;
+        if (!r.ok || (!rel.empty() && !PathAppendW(full, rel.c_str())) || !GetFileAttributesExW(full, GetFileExInfoStandard, &attr)) return false;
+        ULONGLONG current = ((ULONGLONG)attr.ftLastWriteTime.dwHighDateTime << 32) | attr.ftLastWriteTime.dwLowDateTime;
+        if (!(attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || current != writeTime) return false;
+        looseDirs.push_back(std::move(rel));
+    }
+
+    FileIndex index;
+    if (!index.Load(r) || !RefreshLooseRows(index, looseDirs)) return false;
+    std::unordered_map<std::wstring, std::vector<DWORD>> directories;
+    DWORD count = r.Pod<DWORD>();
+    for (DWORD i = 0; i < count && r.ok; i++) {
+        std::vector<DWORD>& rows = directories[r.String()];
+        r.Array(rows);
+        for (DWORD row : rows) if (row >= index.Size()) return false;
+    }
+    std::unordered_map<std::wstring, ShadowedEntry, PathHash, PathEqual> shadowed;
+    count = r.Pod<DWORD>();
+    for (DWORD i = 0; i < count && r.ok; i++) {
+        std::wstring path = r.String();
+        shadowed[path] = r.Pod<ShadowedEntry>();
+    }
+    if (!r.ok) return false;
+
+    g_FileIndex = std::move(index);
+    g_DirectoryIndex = std::move(directories);
+    g_ShadowedArchive = std::move(shadowed);
+    g_ArchiveId = archiveId;
+    return true;
+}
+
+// Maps the snapshot and takes the index from it. The file index is copied column by
+// column; only the loose folder is checked on disk, one listing per directory.
+static bool LoadIndexSnapshot(const wchar_t* path, const SnapshotSource& source) {
+    ScopedRawHandle hFile(g_RawCreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+    LARGE_INTEGER size;
+    if (hFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(hFile, &size) || size.QuadPart == 0 || size.QuadPart > MAXDWORD) return false;
+    ScopedRawHandle hMapping(CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL));
+    if (hMapping == NULL) return false;
+    const BYTE* view = (const BYTE*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) return false;
+    bool loaded = ParseIndexSnapshot(view, (size_t)size.QuadPart, source);
+    UnmapViewOfFile(view);
+    return loaded;
+}
+
+static void SaveIndexSnapshot(const wchar_t* path, const SnapshotSource& source, const std::vector<LooseScan::LooseDirectory>& looseDirs) {
+    std::vector<BYTE> out;
+    PutPod(out, kSnapshotMagic);
+    PutPod(out, kSnapshotVersion);
+    PutPod(out, source);
+    PutPod(out, g_ArchiveId);
+    PutPod(out, (DWORD)looseDirs.size());
+    for (const auto& dir : looseDirs) {
+        PutArray(out, dir.relativePath.c_str(), dir.relativePath.length());
+        PutPod(out, dir.lastWriteTime);
+    }
+    g_FileIndex.Save(out);
+    PutPod(out, (DWORD)g_DirectoryIndex.size());
+    for (const auto& kv : g_DirectoryIndex) {
+        PutArray(out, kv.first.c_str(), kv.first.length());
+        PutArray(out, kv.second.data(), kv.second.size());
+    }
+    PutPod(out, (DWORD)g_ShadowedArchive.size());
+    for (const auto& kv : g_ShadowedArchive) {
+        PutArray(out, kv.first.c_str(), kv.first.length());
+        PutPod(out, kv.second);
+    }
+
+    wchar_t tmp[MAX_PATH];
+    swprintf_s(tmp, L"%s.tmp", path);
+    bool written = false;
+    {
+        ScopedRawHandle hFile(g_RawCreateFileW(tmp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
+        if (hFile == INVALID_HANDLE_VALUE) return;
+        DWORD bw = 0;
+        written = WriteFile(hFile, out.data(), (DWORD)out.size(), &bw, NULL) && bw == out.size();
+    }
+    if (!written || !MoveFileExW(tmp, path, MOVEFILE_REPLACE_EXISTING)) DeleteFileW(tmp);
+}
+
+static bool BuildIndex(HMODULE hModule) {
+    std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+    if (g_IsActive) return true;
+    if (!g_RawReadFile || !g_RawSetFilePointerEx || !g_RawCloseHandle || !g_RawCreateFileW) return false;
+    if (!Config::EnableFileHook) return false;
+
+    // Setup paths
+    wchar_t baseDir[MAX_PATH];
+    GetModuleFileNameW(hModule, baseDir, MAX_PATH);
+    PathRemoveFileSpecW(baseDir);
+
+    g_DecodedCacheBudget = (size_t)Config::VFSDecodeCacheMB * 1024 * 1024;
+    g_MemoryFileBudget = (size_t)Config::VFSMemoryExtractMB * 1024 * 1024;
+    if (Config::VFSMode == 2) ServePolicy::Initialize();
+    Metrics::Initialize(DumpMetrics);
+    Trace::Initialize(TracePath);
+
+    if (Config::VFSMode != 1) { // Modern and automatic mode cache
+        GetTempPathW(MAX_PATH, g_HybridCacheDir);
+        PathAppendW(g_HybridCacheDir, L"VFS_CHS_Cache");
+        if (!PathIsDirectoryW(g_HybridCacheDir)) CreateDirectoryW(g_HybridCacheDir, NULL);
+        ExtractCache::Initialize(g_HybridCacheDir);
+    }
 
-        wcscpy_s(g_LooseFolderPath, baseDir);
-        PathAppendW(g_LooseFolderPath, Config::RedirectFolderW);
+    wchar_t gameRoot[MAX_PATH];
+    GetModuleFileNameW(NULL, gameRoot, MAX_PATH);
+    PathRemoveFileSpecW(gameRoot);
+    g_GameRootDir = NormalizePath(gameRoot);
 
+    wcscpy_s(g_LooseFolderPath, baseDir);
+    PathAppendW(g_LooseFolderPath, Config::RedirectFolderW);
+
+    wcscpy_s(g_ArchivePath, baseDir);
+    PathAppendW(g_ArchivePath, Config::ArchiveFileName);
+    if (!PathFileExistsW(g_ArchivePath)) {
+        wchar_t fb[MAX_PATH]; wcscpy_s(fb, baseDir);
+        PathAppendW(fb, Config::RedirectFolderW); PathAppendW(fb, Config::ArchiveFileName);
+        if (PathFileExistsW(fb)) wcscpy_s(g_ArchivePath, fb);
+    }
+
+    ULONGLONG start = GetTickCount64();
+    ScopedRawHandle hArchive(PathFileExistsW(g_ArchivePath)
+        ? g_RawCreateFileW(g_ArchivePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL)
+        : INVALID_HANDLE_VALUE);
+    if (hArchive != INVALID_HANDLE_VALUE) GetFileTime(hArchive, NULL, NULL, &g_ArchiveWriteTime);
+    if (hArchive != INVALID_HANDLE_VALUE && !OpenArchiveCipher(hArchive)) g_RawCloseHandle(hArchive.release());
+
+    wchar_t snapshotPath[MAX_PATH];
+    swprintf_s(snapshotPath, L"%s.idx", g_ArchivePath);
+    SnapshotSource source = DescribeSnapshotSource(hArchive);
+    bool fromSnapshot = Config::VFSIndexSnapshot && LoadIndexSnapshot(snapshotPath, source);
+
+    if (!fromSnapshot) {
+        std::vector<LooseScan::LooseDirectory> looseDirs;
         if (PathFileExistsW(g_LooseFolderPath) && PathIsDirectoryW(g_LooseFolderPath)) {
-            ScanLooseFiles(g_LooseFolderPath, g_LooseFolderPath, L"");
-        }
-
-        wcscpy_s(g_ArchivePath, baseDir);
-        PathAppendW(g_ArchivePath, Config::ArchiveFileName);
-        if (!PathFileExistsW(g_ArchivePath)) {
-            wchar_t fb[MAX_PATH]; wcscpy_s(fb, baseDir);
-            PathAppendW(fb, Config::RedirectFolderW); PathAppendW(fb, Config::ArchiveFileName);
-            if (PathFileExistsW(fb)) wcscpy_s(g_ArchivePath, fb);
-        }
-
-        if (PathFileExistsW(g_ArchivePath)) {
-            ScopedRawHandle hArchive(g_RawCreateFileW(g_ArchivePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
-            if (hArchive != INVALID_HANDLE_VALUE) {
-                DWORD br; int count = 0;
-                if (g_RawReadFile(hArchive, &count, sizeof(int), &br, NULL)) {
-                    for (int i = 0; i < count; i++) {
-                        int pLen = 0; g_RawReadFile(hArchive, &pLen, sizeof(int), &br, NULL);
-                        std::vector<char> pBuf(pLen + 1, '\0'); g_RawReadFile(hArchive, pBuf.data(), pLen, &br, NULL);
-                        wchar_t wPath[MAX_PATH]; MultiByteToWideChar(CP_UTF8, 0, pBuf.data(), -1, wPath, MAX_PATH);
-                        int dSize = 0; g_RawReadFile(hArchive, &dSize, sizeof(int), &br, NULL);
-                        int sSize = 0; g_RawReadFile(hArchive, &sSize, sizeof(int), &br, NULL);
-                        LARGE_INTEGER cur; LARGE_INTEGER zero = { 0 };
-                        g_RawSetFilePointerEx(hArchive, zero, &cur, FILE_CURRENT);
-                        std::wstring norm = NormalizePath(wPath);
-                        if (g_FileIndex.find(norm) == g_FileIndex.end()) {
-                            VirtualFileEntry e; e.relativePath = wPath; e.offset = cur.QuadPart;
-                            e.size = sSize; e.decompressedSize = dSize; e.isLooseFile = false;
-                            g_FileIndex[norm] = e;
-                        }
-                        LARGE_INTEGER skip; skip.QuadPart = sSize;
-                        g_RawSetFilePointerEx(hArchive, skip, NULL, FILE_CURRENT);
+            ScanLooseFiles(&looseDirs);
+        }
+
+        if (hArchive != INVALID_HANDLE_VALUE) {
+            LARGE_INTEGER archiveSize = { 0 };
+            GetFileSizeEx(hArchive, &archiveSize);
+            g_ArchiveId = Utils::HashBytes(&archiveSize, sizeof(archiveSize));
+            DWORD br; int count = 0;
+            LARGE_INTEGER dataStart; dataStart.QuadPart = g_ArchiveDataStart;
+            g_RawSetFilePointerEx(hArchive, dataStart, NULL, FILE_BEGIN);
+            if (g_RawReadFile(hArchive, &count, sizeof(int), &br, NULL)) {
+                for (int i = 0; i < count; i++) {
+                    int pLen = 0; g_RawReadFile(hArchive, &pLen, sizeof(int), &br, NULL);
+                    std::vector<char> pBuf(pLen + 1, '\0'); g_RawReadFile(hArchive, pBuf.data(), pLen, &br, NULL);
+                    wchar_t wPath[MAX_PATH]; MultiByteToWideChar(CP_UTF8, 0, pBuf.data(), -1, wPath, MAX_PATH);
+                    int dSize = 0; g_RawReadFile(hArchive, &dSize, sizeof(int), &br, NULL);
+                    int sSize = 0; g_RawReadFile(hArchive, &sSize, sizeof(int), &br, NULL);
+                    g_ArchiveId = Utils::HashBytes(pBuf.data(), pLen, g_ArchiveId);
+                    g_ArchiveId = Utils::HashBytes(&dSize, sizeof(dSize), g_ArchiveId);
+                    g_ArchiveId = Utils::HashBytes(&sSize, sizeof(sSize), g_ArchiveId);
+                    LARGE_INTEGER cur; LARGE_INTEGER zero = { 0 };
+                    g_RawSetFilePointerEx(hArchive, zero, &cur, FILE_CURRENT);
+                    if (!g_FileIndex.Add(wPath, cur.QuadPart, sSize, dSize, 0)) {
+                        g_ShadowedArchive[wPath] = { cur.QuadPart, (DWORD)sSize, (DWORD)dSize };
                     }
+                    LARGE_INTEGER skip; skip.QuadPart = sSize;
+                    g_RawSetFilePointerEx(hArchive, skip, NULL, FILE_CURRENT);
                 }
-                g_ArchiveHandle = hArchive.release();
             }
         }
 
-        g_IsActive = !g_FileIndex.empty();
-        if (g_IsActive) {
-            RebuildDirectoryIndex();
-            Utils::Log("[VFS] Initialized in %s mode with %zu files (%zu directories)", 
-                (Config::VFSMode == 0 ? "Modern" : "Legacy"), g_FileIndex.size(), g_DirectoryIndex.size());
+        g_FileIndex.Compact();
+        RebuildDirectoryIndex();
+        if (Config::VFSIndexSnapshot && g_FileIndex.Size() != 0) SaveIndexSnapshot(snapshotPath, source, looseDirs);
+    }
+
+    if (hArchive != INVALID_HANDLE_VALUE) {
+        g_ArchiveHandle = hArchive.release();
+        if (!MapArchive(g_ArchiveHandle)) Utils::Log("[VFS] Archive mapping unavailable, using ReadFile path");
+    }
+
+    RebuildPathFilter();
+    g_NarrowIndex.Build(g_FileIndex, Config::LE_Codepage);
+    g_IsActive = g_FileIndex.Size() != 0;
+    if (g_IsActive) {
+        Utils::Log("[VFS] Index %s in %llu ms", fromSnapshot ? "loaded from snapshot" : "built", GetTickCount64() - start);
+        Metrics::SetIndexBuild(GetTickCount64() - start, fromSnapshot, g_FileIndex.Size());
+        StartPrefetch();
+        StartLiveReload();
+        if (Config::VFSMode != 1 && Config::VFSPreExtract[0] && ExtractCache::IsReady()) {
+            HANDLE hThread = CreateThread(NULL, 0, PreExtractWorker, NULL, 0, NULL);
+            if (hThread) CloseHandle(hThread);
         }
-        return g_IsActive;
+        Utils::Log("[VFS] Initialized in %s mode with %zu files (%zu directories, %zu KB index, %zu KB narrow keys)", 
+            (Config::VFSMode == 0 ? "Modern" : Config::VFSMode == 2 ? "Automatic" : "Legacy"), g_FileIndex.Size(), g_DirectoryIndex.size(),
+            g_FileIndex.MemoryUsage() / 1024, g_NarrowIndex.MemoryUsage() / 1024);
+    }
+    return g_IsActive;
+}
+
+// Runs once, on whichever thread claims it first: normally the worker started by Initialize,
+// or a lookup that found the worker not started yet (it cannot run under the loader lock).
+static void RunInitialize() {
+    if (InterlockedCompareExchange(&g_InitState, kInitRunning, kInitIdle) != kInitIdle) return;
+    g_InitThreadId = GetCurrentThreadId();
+    BuildIndex(g_InitModule);
+
+    // Everything up to the first blocked lookup used to be spent inside DllMain
+    ULONGLONG ready = GetTickCount64() - g_InitStartTick;
+    if (g_FirstWaitTick) {
+        ULONGLONG saved = (ULONGLONG)g_FirstWaitTick - g_InitStartTick;
+        Utils::Log("[VFS] Index ready %llu ms after attach; a lookup waited %llu ms for it (%llu ms of startup saved)",
+            ready, ready - saved, saved);
+    } else {
+        Utils::Log("[VFS] Index ready %llu ms after attach without blocking the game (%llu ms of startup saved)", ready, ready);
+    }
+    InterlockedExchange(&g_InitState, kInitDone);
+    SetEvent(g_InitDone);
+}
+
+static DWORD WINAPI InitializeWorker(LPVOID) {
+    RunInitialize();
+    return 0;
+}
+
+// Readiness latch for the lookup entry points. The init thread and the loose scan workers
+// reach the hooks while the index is being built and must not wait for themselves; they
+// get whatever is active so far (nothing before the build ends).
+static bool WaitForIndex() {
+    if (g_InitState == kInitDone) return g_IsActive;
+    if (!g_InitDone) return false; // Initialize was never called
+    if (g_InitState == kInitRunning && (GetCurrentThreadId() == g_InitThreadId || LooseScan::IsScanThread())) return g_IsActive;
+    InterlockedCompareExchange64(&g_FirstWaitTick, (LONGLONG)GetTickCount64(), 0);
+    RunInitialize();
+    WaitForSingleObject(g_InitDone, INFINITE);
+    return g_IsActive;
+}
+
+namespace VFS {
+    void Initialize(HMODULE hModule) {
+        if (g_InitDone) return;
+        g_RawReadFile = (pReadFile)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "ReadFile");
+        g_RawSetFilePointerEx = (pSetFilePointerEx)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "SetFilePointerEx");
+        g_RawCloseHandle = (pCloseHandle)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "CloseHandle");
+        g_RawCreateFileW = (pCreateFileW)GetProcAddress(GetModuleHandleW(L"kernel32.dll"), "CreateFileW");
+
+        g_InitModule = hModule;
+        g_InitStartTick = GetTickCount64();
+        g_InitDone = CreateEventW(NULL, TRUE, FALSE, NULL);
+        HANDLE hThread = g_InitDone ? CreateThread(NULL, 0, InitializeWorker, NULL, 0, NULL) : NULL;
+        if (hThread) CloseHandle(hThread);
+        else RunInitialize();
     }
 
     void Shutdown() {
+        // A build still running at exit was cut off with its thread, possibly inside g_Mutex
+        if (g_InitState != kInitDone) return;
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        g_HandleMap.clear(); // std::unique_ptr will handle deletion
-        g_FindMap.clear();
+        InterlockedIncrement(&g_IndexGeneration); // rows cached by the hooks no longer apply
+        g_HandleTable.Clear();
+        g_FindTable.Clear();
+
+        StopPrefetch();
+        StopLiveReload();
+        if (Config::EnableDebug && (g_DecodedCacheHits || g_DecodedCacheMisses)) {
+            Utils::Log("[VFS-Cache] Decoded cache: %llu hits, %llu misses, %zu KB resident",
+                g_DecodedCacheHits, g_DecodedCacheMisses, g_DecodedCacheBytes / 1024);
+        }
+        if (g_PrefetchDecoded) {
+            Utils::Log("[VFS-Prefetch] %llu entries prefetched, %llu used (%.1f%% hit rate)",
+                g_PrefetchDecoded, g_PrefetchUsed, 100.0 * g_PrefetchUsed / g_PrefetchDecoded);
+        }
+        ClearDecodedCache();
+        Metrics::WriteJson("shutdown", MetricsPaths);
+        Metrics::Shutdown();
+        Trace::Shutdown();
 
+        // Extracted files stay on disk for the next launch; the cache manages their lifetime
         for (auto& p : g_MixedHandleMap) {
             if (g_RawCloseHandle) g_RawCloseHandle(p.first);
-            DeleteFileW(p.second.c_str());
         }
         g_MixedHandleMap.clear();
-        g_FileIndex.clear();
+        ClearMemoryFiles();
+        g_RowUsage.clear();
+        g_RowLogged.clear();
+        {
+            std::lock_guard<std::mutex> directLock(g_DirectMutex);
+            g_DirectMappings.clear(); // the handles and views belong to the game now
+            g_DirectObjects = 0;
+        }
+        ExtractCache::Shutdown();
+        g_FileIndex.Clear();
+        g_NarrowIndex = NarrowIndex();
         g_DirectoryIndex.clear();
+        g_PathFilter.Clear();
+        g_ShadowedArchive.clear();
+        UnmapArchive();
         if (g_ArchiveHandle != INVALID_HANDLE_VALUE) {
             if (g_RawCloseHandle) g_RawCloseHandle(g_ArchiveHandle);
             g_ArchiveHandle = INVALID_HANDLE_VALUE;
         }
+        g_ArchiveEncrypted = false;
+        SecureZeroMemory(&g_ArchiveKey, sizeof(g_ArchiveKey));
         g_IsActive = false;
     }
 
     bool IsActive() { return g_IsActive; }
 
+    bool WaitUntilReady() { return WaitForIndex(); }
+
     void SetOriginalFunctions(void* r, void* s, void* c) {
         g_OrigReadFile = (pReadFile)r; g_OrigSetFilePointerEx = (pSetFilePointerEx)s; g_OrigCloseHandle = (pCloseHandle)c;
     }
@@ -284,153 +1955,333 @@ namespace VFS {
         g_OrigFindFirstFileA = (pFindFirstFileA)f4; g_OrigFindNextFileA = (pFindNextFileA)f5;
     }
 
+    bool MayBeVirtual(const wchar_t* path) {
+        t_QueryKey = 0;
+        if (!path || !WaitForIndex() || !g_PathFilter.MayContain(path, false)) return false;
+        return QueryPathCache(PathCacheKey(path), IsAbsolutePath(path));
+    }
+
+    bool MayBeVirtualA(const char* path) {
+        t_QueryKey = 0;
+        if (!path || !WaitForIndex() || !g_PathFilter.MayContain(path, false)) return false;
+        return QueryPathCache(PathCacheKey(path), IsAbsolutePath(path));
+    }
+
+    bool MayContainVirtual(const wchar_t* pattern) { return pattern && WaitForIndex() && g_PathFilter.MayContain(pattern, true); }
+    bool MayContainVirtualA(const char* pattern) { return pattern && WaitForIndex() && g_PathFilter.MayContain(pattern, true); }
+
+    void NoteNotVirtual(const wchar_t* path) {
+        t_QueryKey = 0;
+        if (!path || !IsAbsolutePath(path)) return;
+        ULONGLONG key = PathCacheKey(path);
+        t_PathCache[key % kPathCacheSlots] = { key, g_IndexGeneration, FileIndex::kNone };
+    }
+
+    void NoteNotVirtualA(const char* path) {
+        t_QueryKey = 0;
+        if (!path || !IsAbsolutePath(path)) return;
+        ULONGLONG key = PathCacheKey(path);
+        t_PathCache[key % kPathCacheSlots] = { key, g_IndexGeneration, FileIndex::kNone };
+    }
+
+    HANDLE OpenCachedVirtualFile() {
+        if (!t_QueryKey) return INVALID_HANDLE_VALUE;
+        Trace::Scope trace(Trace::OPEN);
+        std::unique_lock<std::recursive_mutex> lock(g_Mutex);
+        DWORD row = CachedQueryRow();
+        if (row == FileIndex::kNone) { trace.Cancel(); return INVALID_HANDLE_VALUE; }
+        return OpenVirtualRow(row, lock, trace);
+    }
+
+    bool GetCachedVirtualFileInfo(VirtualFileInfo* info) {
+        if (!t_QueryKey || !info) return false;
+        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+        DWORD row = CachedQueryRow();
+        if (row == FileIndex::kNone) return false;
+        FillFileInfo(g_FileIndex.Entry(row), info);
+        return true;
+    }
+
     bool HasVirtualFile(const wchar_t* p) {
-        if (!g_IsActive || !p) return false;
+        if (!p || !WaitForIndex()) return false;
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        return g_FileIndex.find(NormalizePath(p)) != g_FileIndex.end();
+        return g_FileIndex.Find(p) != FileIndex::kNone;
     }
 
     bool HasVirtualFileA(const char* p) {
-        if (!g_IsActive || !p) return false;
+        if (!WaitForIndex()) return false;
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        return g_FileIndex.find(NormalizePathA(p)) != g_FileIndex.end();
+        return FindRowA(p) != FileIndex::kNone;
     }
 
-    HANDLE OpenVirtualFile(const wchar_t* relativePath) {
-        if (!g_IsActive || !relativePath) return INVALID_HANDLE_VALUE;
-        std::wstring norm = NormalizePath(relativePath);
+    bool GetVirtualFileInfo(const wchar_t* p, VirtualFileInfo* info) {
+        if (!p || !info || !WaitForIndex()) return false;
+        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+        DWORD row = g_FileIndex.Find(p);
+        if (row == FileIndex::kNone) return false;
+        NoteQueryRow(row);
+        FillFileInfo(g_FileIndex.Entry(row), info);
+        return true;
+    }
+
+    bool GetVirtualFileInfoA(const char* p, VirtualFileInfo* info) {
+        if (!info || !WaitForIndex()) return false;
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_FileIndex.find(norm);
-        if (it == g_FileIndex.end()) return INVALID_HANDLE_VALUE;
+        DWORD row = FindRowA(p);
+        if (row == FileIndex::kNone) return false;
+        NoteQueryRow(row);
+        FillFileInfo(g_FileIndex.Entry(row), info);
+        return true;
+    }
+
+    // Opens an index row found by one of the OpenVirtualFile entry points, with lock held.
+    static HANDLE OpenVirtualRow(DWORD row, std::unique_lock<std::recursive_mutex>& lock, Trace::Scope& trace) {
+        VirtualFileEntry entry = g_FileIndex.Entry(row);
+        trace.row = row; trace.size = entry.decompressedSize;
+        NotePrefetchAccess(row);
+        Metrics::Add(row, Metrics::OPENS);
+
+        wchar_t loosePath[MAX_PATH];
+        if (entry.isLooseFile && !GetLoosePath(row, loosePath)) return INVALID_HANDLE_VALUE;
+
+        // Modern serves real handles, Legacy emulated ones, automatic mode decides per entry
+        bool real = Config::VFSMode == 0 || (Config::VFSMode == 2 && ChooseRealHandle(row, entry));
 
         // Legacy special handling for certain extensions (returns real handle directly)
-        if (Config::VFSMode != 0) {
-            const wchar_t* ext = PathFindExtensionW(relativePath);
+        if (!real) {
+            const wchar_t* ext = PathFindExtensionW(g_FileIndex.Path(row));
             if (ext && (_wcsicmp(ext, L".dll") == 0 || _wcsicmp(ext, L".exe") == 0 || _wcsicmp(ext, L".asi") == 0)) {
-                if (it->second.isLooseFile) return g_RawCreateFileW(it->second.looseFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+                if (entry.isLooseFile) return g_RawCreateFileW(loosePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
             }
         }
 
         // Modern mode loose file optimization
-        if (Config::VFSMode == 0 && it->second.isLooseFile) {
-            return g_RawCreateFileW(it->second.looseFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (real && entry.isLooseFile) {
+            return g_RawCreateFileW(loosePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
         }
 
-        // Modern mode cache extraction
-        if (Config::VFSMode == 0 && !it->second.isLooseFile) {
-            wchar_t cName[MAX_PATH]; swprintf_s(cName, L"vfs_%u.tmp", (UINT)it->second.offset);
-            wchar_t cPath[MAX_PATH]; wcscpy_s(cPath, g_HybridCacheDir); PathAppendW(cPath, cName);
-            if (!PathFileExistsW(cPath)) {
-                if (!ExtractFile(relativePath, cPath)) return INVALID_HANDLE_VALUE;
+        // Modern mode cache extraction: a memory file, else the disk cache
+        if (real && !entry.isLooseFile && ExtractCache::IsReady()) {
+            ULONGLONG key = ExtractCacheKey(entry);
+            wchar_t cPath[MAX_PATH];
+            HANDLE hReal = OpenMemoryFile(key, cPath);
+            bool inMemory = hReal != INVALID_HANDLE_VALUE;
+            bool cached = inMemory || ExtractCache::Lookup(key, cPath);
+            Metrics::Add(row, cached ? Metrics::CACHE_HITS : Metrics::CACHE_MISSES);
+            if (!cached) {
+                std::shared_ptr<ExtractJob> job = QueueExtraction(key, entry, FitsMemoryFiles(entry));
+                if (!job) return INVALID_HANDLE_VALUE;
+                // Only this thread waits for the entry; the index stays usable meanwhile
+                lock.unlock();
+                WaitForSingleObject(job->done, INFINITE);
+                lock.lock();
+                inMemory = job->inMemory;
+                if (!job->succeeded) cPath[0] = L'\0';
+                else if (inMemory) hReal = OpenMemoryFile(key, cPath);
+                else wcscpy_s(cPath, job->path);
+            }
+            // A memory file that failed or was evicted meanwhile is extracted to the disk cache instead
+            if (inMemory && hReal == INVALID_HANDLE_VALUE) {
+                inMemory = false;
+                if (!ExtractCache::Lookup(key, cPath)) {
+                    std::shared_ptr<ExtractJob> job = QueueExtraction(key, entry, false);
+                    if (job) {
+                        lock.unlock();
+                        WaitForSingleObject(job->done, INFINITE);
+                        lock.lock();
+                    }
+                    if (job && job->succeeded && !job->inMemory) wcscpy_s(cPath, job->path);
+                    else cPath[0] = L'\0';
+                }
             }
-            HANDLE hReal = g_RawCreateFileW(cPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            if (!inMemory && cPath[0]) hReal = g_RawCreateFileW(cPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
             if (hReal != INVALID_HANDLE_VALUE) { g_MixedHandleMap[hReal] = cPath; return hReal; }
+            // Emulated only when neither cache could produce the file
         }
 
         // Fallback or Legacy mode emulated handle
-        auto vfh = std::make_unique<VirtualFileHandle>();
-        vfh->entry = &it->second; 
+        VirtualFileHandle* vfh = nullptr;
+        HANDLE hFake = g_HandleTable.Alloc(&vfh);
+        if (hFake == INVALID_HANDLE_VALUE) {
+            Utils::Log("[VFS] All %u virtual handle slots are in use", (DWORD)g_HandleTable.kCapacity);
+            SetLastError(ERROR_TOO_MANY_OPEN_FILES);
+            return INVALID_HANDLE_VALUE;
+        }
+        vfh->entry = entry; 
         vfh->position = 0; 
-        vfh->isLooseFile = it->second.isLooseFile;
+        vfh->isLooseFile = entry.isLooseFile;
         vfh->archiveHandle = g_ArchiveHandle;
         vfh->looseFileHandle = INVALID_HANDLE_VALUE;
 
         if (vfh->isLooseFile) {
-            vfh->looseFileHandle = g_RawCreateFileW(it->second.looseFilePath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-        } else if (it->second.size < it->second.decompressedSize) {
-            // Memory decompression for Legacy or fallback
-            std::vector<BYTE> comp(it->second.size); 
-            LARGE_INTEGER s; s.QuadPart = it->second.offset;
-            if (g_RawSetFilePointerEx(g_ArchiveHandle, s, NULL, FILE_BEGIN)) {
-                DWORD br; 
-                if (g_RawReadFile(g_ArchiveHandle, comp.data(), it->second.size, &br, NULL)) {
-                    vfh->decompressedBuffer.resize(it->second.decompressedSize);
-                    if (!DecompressData(comp, it->second.decompressedSize, vfh->decompressedBuffer.data())) {
-                        vfh->decompressedBuffer.clear();
+            vfh->looseFileHandle = g_RawCreateFileW(loosePath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+            BY_HANDLE_FILE_INFORMATION fi;
+            if (vfh->looseFileHandle != INVALID_HANDLE_VALUE && GetFileInformationByHandle(vfh->looseFileHandle, &fi)) {
+                g_FileIndex.UpdateLoose(row, fi.nFileSizeLow, fi.ftLastWriteTime);
+                vfh->entry = g_FileIndex.Entry(row);
+            }
+        } else if (UsesDecodedCache(entry)) {
+            auto stream = std::make_unique<ChunkStream>();
+            if (ReadChunkTable(entry, *stream)) {
+                // Chunked entries are decoded just ahead of the read position instead of up front
+                vfh->stream = std::move(stream);
+            } else {
+                // Memory decompression for Legacy or fallback, shared through the decoded cache
+                ULONGLONG hitsBefore = g_DecodedCacheHits;
+                ULONGLONG prefetchUsedBefore = g_PrefetchUsed;
+                vfh->decompressedBuffer = GetDecodedEntry(entry);
+                if (Config::EnableDebug) {
+                    Utils::LogW(L"[VFS-Cache] %s: %s (%llu hits / %llu misses, %zu KB resident)", g_FileIndex.Path(row),
+                        !vfh->decompressedBuffer ? L"decode failed" : (g_PrefetchUsed != prefetchUsedBefore ? L"prefetch hit" :
+                        (g_DecodedCacheHits != hitsBefore ? L"hit" : L"miss")),
+                        g_DecodedCacheHits, g_DecodedCacheMisses, g_DecodedCacheBytes / 1024);
+                    if (g_PrefetchDecoded) {
+                        Utils::Log("[VFS-Prefetch] %llu prefetched, %llu used (%.1f%% hit rate)",
+                            g_PrefetchDecoded, g_PrefetchUsed, 100.0 * g_PrefetchUsed / g_PrefetchDecoded);
                     }
                 }
             }
         }
 
-        HANDLE hFake = (HANDLE)(++g_VirtualHandleCounter);
-        g_HandleMap[hFake] = std::move(vfh);
         return hFake;
     }
 
+    HANDLE OpenVirtualFile(const wchar_t* relativePath) {
+        if (!relativePath || !WaitForIndex()) return INVALID_HANDLE_VALUE;
+        Trace::Scope trace(Trace::OPEN);
+        std::unique_lock<std::recursive_mutex> lock(g_Mutex);
+        DWORD row = g_FileIndex.Find(relativePath);
+        if (row == FileIndex::kNone) { trace.Cancel(); return INVALID_HANDLE_VALUE; }
+        NoteQueryRow(row);
+        return OpenVirtualRow(row, lock, trace);
+    }
+
     HANDLE OpenVirtualFileA(const char* p) {
-        wchar_t w[MAX_PATH]; MultiByteToWideChar(Config::LE_Codepage, 0, p, -1, w, MAX_PATH);
-        return OpenVirtualFile(w);
+        if (!WaitForIndex()) return INVALID_HANDLE_VALUE;
+        Trace::Scope trace(Trace::OPEN);
+        std::unique_lock<std::recursive_mutex> lock(g_Mutex);
+        DWORD row = FindRowA(p);
+        if (row == FileIndex::kNone) { trace.Cancel(); return INVALID_HANDLE_VALUE; }
+        NoteQueryRow(row);
+        return OpenVirtualRow(row, lock, trace);
     }
 
     bool IsVirtualHandle(HANDLE h) {
         if (!g_IsActive) return false;
-        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        return g_HandleMap.find(h) != g_HandleMap.end();
+        return g_HandleTable.Get(h) != nullptr;
+    }
+
+    // Reads [position, position + n) of a loose or stored entry from the file system,
+    // through the handle's read-ahead window.
+    static DWORD ReadThroughReadAhead(VirtualFileHandle* vfh, BYTE* b, DWORD n) {
+        HANDLE hSrc = vfh->isLooseFile ? vfh->looseFileHandle : vfh->archiveHandle;
+        LONGLONG base = vfh->isLooseFile ? 0 : vfh->entry.offset;
+        return vfh->readAhead.Read(vfh->position, b, n, vfh->entry.decompressedSize, [&](LONGLONG pos, BYTE* dst, DWORD len) {
+            LARGE_INTEGER s; s.QuadPart = base + pos;
+            g_RawSetFilePointerEx(hSrc, s, NULL, FILE_BEGIN);
+            DWORD got = 0;
+            g_RawReadFile(hSrc, dst, len, &got, NULL);
+            if (!vfh->isLooseFile) DecryptArchiveBytes(s.QuadPart, dst, got);
+            return got;
+        });
     }
 
     BOOL ReadVirtualFile(HANDLE h, LPVOID b, DWORD n, LPDWORD r, LPOVERLAPPED o) {
+        Trace::Scope trace(Trace::READ);
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_HandleMap.find(h); if (it == g_HandleMap.end()) return FALSE;
-        VirtualFileHandle* vfh = it->second.get();
-        LONGLONG rem = vfh->entry->decompressedSize - vfh->position;
+        VirtualFileHandle* vfh = g_HandleTable.Get(h); if (!vfh) return FALSE;
+        trace.row = vfh->entry.index;
+        LONGLONG rem = vfh->entry.decompressedSize - vfh->position;
         if (rem <= 0) { if (r) *r = 0; return TRUE; }
         DWORD toRead = (DWORD)min((LONGLONG)n, rem); DWORD br = 0;
 
-        if (!vfh->decompressedBuffer.empty()) {
-            memcpy(b, vfh->decompressedBuffer.data() + vfh->position, toRead); br = toRead;
+        const BYTE* mapped = nullptr;
+        if (vfh->stream) {
+            ChunkStream* cs = vfh->stream.get();
+            while (br < toRead) {
+                LONGLONG pos = vfh->position + br;
+                DWORD index = (DWORD)(pos / cs->chunkSize);
+                if (index != cs->decodedChunk) {
+                    cs->decoded.resize(ChunkLength(vfh->entry, *cs, index));
+                    ULONGLONG decodeStart = Metrics::Now(), traceStart = Trace::Now();
+                    if (!DecodeChunk(vfh->entry, *cs, index, cs->decoded.data())) { cs->decodedChunk = MAXDWORD; break; }
+                    cs->decodedChunk = index;
+                    Trace::Record(Trace::DECODE, vfh->entry.index, cs->decoded.size(), traceStart);
+                    Metrics::Add(vfh->entry.index, Metrics::DECODES);
+                    Metrics::Add(vfh->entry.index, Metrics::DECODE_US, Metrics::Now() - decodeStart);
+                }
+                DWORD inChunk = (DWORD)(pos - (LONGLONG)index * cs->chunkSize);
+                DWORD n = min(toRead - br, (DWORD)cs->decoded.size() - inChunk);
+                memcpy((BYTE*)b + br, cs->decoded.data() + inChunk, n); br += n;
+            }
+        } else if (vfh->decompressedBuffer) {
+            memcpy(b, vfh->decompressedBuffer->data() + vfh->position, toRead); br = toRead;
+        } else if (!vfh->isLooseFile && (mapped = MapArchiveRange(vfh->entry.offset + vfh->position, toRead)) != nullptr) {
+            memcpy(b, mapped, toRead); br = toRead;
+            DecryptArchiveBytes(vfh->entry.offset + vfh->position, b, br);
         } else {
-            HANDLE hSrc = vfh->isLooseFile ? vfh->looseFileHandle : vfh->archiveHandle;
-            LARGE_INTEGER s; s.QuadPart = (vfh->isLooseFile ? 0 : vfh->entry->offset) + vfh->position;
-            g_RawSetFilePointerEx(hSrc, s, NULL, FILE_BEGIN);
-            g_RawReadFile(hSrc, b, toRead, &br, NULL);
+            br = ReadThroughReadAhead(vfh, (BYTE*)b, toRead);
         }
         vfh->position += br; if (r) *r = br;
+        trace.size = br;
+        Metrics::Add(vfh->entry.index, Metrics::READS);
+        Metrics::Add(vfh->entry.index, Metrics::BYTES_SERVED, br);
         return TRUE;
     }
 
     DWORD SetVirtualFilePointer(HANDLE h, LONG d, PLONG dh, DWORD m) {
+        Trace::Scope trace(Trace::SEEK);
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_HandleMap.find(h); if (it == g_HandleMap.end()) return INVALID_SET_FILE_POINTER;
-        VirtualFileHandle* vfh = it->second.get();
+        VirtualFileHandle* vfh = g_HandleTable.Get(h); if (!vfh) return INVALID_SET_FILE_POINTER;
+        trace.row = vfh->entry.index;
         LONGLONG dist = d; if (dh) dist |= ((LONGLONG)*dh) << 32;
         LONGLONG nPos = 0;
         if (m == FILE_BEGIN) nPos = dist;
         else if (m == FILE_CURRENT) nPos = vfh->position + dist;
-        else if (m == FILE_END) nPos = vfh->entry->decompressedSize + dist;
-        if (nPos < 0) nPos = 0; if (nPos > (LONGLONG)vfh->entry->decompressedSize) nPos = vfh->entry->decompressedSize;
-        vfh->position = nPos;
+        else if (m == FILE_END) nPos = vfh->entry.decompressedSize + dist;
+        if (nPos < 0) nPos = 0; if (nPos > (LONGLONG)vfh->entry.decompressedSize) nPos = vfh->entry.decompressedSize;
+        vfh->position = nPos; trace.size = nPos;
         if (dh) *dh = (LONG)(nPos >> 32);
         return (DWORD)(nPos & 0xFFFFFFFF);
     }
 
     BOOL SetVirtualFilePointerEx(HANDLE h, LARGE_INTEGER d, PLARGE_INTEGER np, DWORD m) {
+        Trace::Scope trace(Trace::SEEK);
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_HandleMap.find(h); if (it == g_HandleMap.end()) return FALSE;
-        VirtualFileHandle* vfh = it->second.get();
+        VirtualFileHandle* vfh = g_HandleTable.Get(h); if (!vfh) return FALSE;
+        trace.row = vfh->entry.index;
         LONGLONG nPos = 0;
         if (m == FILE_BEGIN) nPos = d.QuadPart;
         else if (m == FILE_CURRENT) nPos = vfh->position + d.QuadPart;
-        else if (m == FILE_END) nPos = vfh->entry->decompressedSize + d.QuadPart;
-        if (nPos < 0) nPos = 0; if (nPos > (LONGLONG)vfh->entry->decompressedSize) nPos = vfh->entry->decompressedSize;
-        vfh->position = nPos; if (np) np->QuadPart = nPos;
+        else if (m == FILE_END) nPos = vfh->entry.decompressedSize + d.QuadPart;
+        if (nPos < 0) nPos = 0; if (nPos > (LONGLONG)vfh->entry.decompressedSize) nPos = vfh->entry.decompressedSize;
+        vfh->position = nPos; trace.size = nPos; if (np) np->QuadPart = nPos;
         return TRUE;
     }
 
     DWORD GetVirtualFileSize(HANDLE h, LPDWORD hs) {
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_HandleMap.find(h); if (it == g_HandleMap.end()) return INVALID_FILE_SIZE;
-        if (hs) *hs = (DWORD)((ULONGLONG)it->second->entry->decompressedSize >> 32);
-        return (DWORD)(it->second->entry->decompressedSize & 0xFFFFFFFF);
+        VirtualFileHandle* vfh = g_HandleTable.Get(h); if (!vfh) return INVALID_FILE_SIZE;
+        if (hs) *hs = (DWORD)((ULONGLONG)vfh->entry.decompressedSize >> 32);
+        return (DWORD)(vfh->entry.decompressedSize & 0xFFFFFFFF);
+    }
+
+    void NoteUnhookedUse(HANDLE h, const char* api) {
+        if (Config::VFSMode != 2 || !g_IsActive) return;
+        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+        VirtualFileHandle* vfh = g_HandleTable.Get(h);
+        if (vfh && !vfh->isLooseFile) NoteRowUsage(vfh->entry.index, ServePolicy::USED_UNHOOKED, api);
     }
 
     BOOL GetVirtualFileSizeEx(HANDLE h, PLARGE_INTEGER s) {
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_HandleMap.find(h); if (it == g_HandleMap.end()) return FALSE;
-        if (s) s->QuadPart = it->second->entry->decompressedSize;
+        VirtualFileHandle* vfh = g_HandleTable.Get(h); if (!vfh) return FALSE;
+        if (s) s->QuadPart = vfh->entry.decompressedSize;
         return TRUE;
     }
 
     BOOL CloseVirtualHandle(HANDLE h) {
+        Trace::Scope trace(Trace::CLOSE);
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
         auto it_m = g_MixedHandleMap.find(h);
         if (it_m != g_MixedHandleMap.end()) { 
@@ -438,34 +2289,125 @@ namespace VFS {
             g_MixedHandleMap.erase(it_m); 
             return TRUE; 
         }
-        auto it = g_HandleMap.find(h); if (it == g_HandleMap.end()) return FALSE;
-        VirtualFileHandle* vfh = it->second.get();
+        VirtualFileHandle* vfh = g_HandleTable.Get(h); if (!vfh) return FALSE;
+        trace.row = vfh->entry.index;
         if (vfh->isLooseFile && vfh->looseFileHandle != INVALID_HANDLE_VALUE) {
             if (g_RawCloseHandle) g_RawCloseHandle(vfh->looseFileHandle);
         }
-        // std::unique_ptr will handle memory deletion and vector cleanup
-        g_HandleMap.erase(it);
+        g_HandleTable.Free(h);
         return TRUE;
     }
 
     BOOL GetVirtualFileInformationByHandle(HANDLE h, LPBY_HANDLE_FILE_INFORMATION i) {
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_HandleMap.find(h); if (it == g_HandleMap.end()) return FALSE;
+        VirtualFileHandle* vfh = g_HandleTable.Get(h); if (!vfh) return FALSE;
+        VirtualFileInfo info; FillFileInfo(vfh->entry, &info);
         ZeroMemory(i, sizeof(BY_HANDLE_FILE_INFORMATION));
-        i->dwFileAttributes = FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_READONLY;
-        i->nFileSizeLow = (DWORD)(it->second->entry->decompressedSize & 0xFFFFFFFF);
-        i->nFileSizeHigh = (DWORD)((ULONGLONG)it->second->entry->decompressedSize >> 32);
+        i->dwFileAttributes = info.attributes;
+        i->ftCreationTime = info.creationTime;
+        i->ftLastAccessTime = info.lastAccessTime;
+        i->ftLastWriteTime = info.lastWriteTime;
+        i->nFileSizeLow = (DWORD)(info.size & 0xFFFFFFFF);
+        i->nFileSizeHigh = (DWORD)(info.size >> 32);
         i->nNumberOfLinks = 1;
         return TRUE;
     }
 
     DWORD GetVirtualFileType(HANDLE h) { return IsVirtualHandle(h) ? FILE_TYPE_DISK : FILE_TYPE_UNKNOWN; }
 
+    HANDLE CreateVirtualFileMapping(HANDLE h, LPSECURITY_ATTRIBUTES sa, DWORD protect, DWORD maxHigh, DWORD maxLow, LPCWSTR name) {
+        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+        VirtualFileHandle* vfh = g_HandleTable.Get(h);
+        if (!vfh) { SetLastError(ERROR_INVALID_HANDLE); return NULL; }
+        VirtualFileEntry e = vfh->entry;
+        ULONGLONG requested = ((ULONGLONG)maxHigh << 32) | maxLow;
+        ULONGLONG size = requested ? requested : e.decompressedSize;
+        if (size == 0) { SetLastError(ERROR_FILE_INVALID); return NULL; }
+
+        // Stored entries map straight out of the archive: no copy, pages shared with the cache.
+        // The entry has to start on a granularity boundary and end on a page boundary (or at the
+        // end of the archive), so no view exposes bytes of a neighbouring entry: past the end
+        // of the entry a mapped file reads as zeros.
+        DWORD access = protect & 0xFF;
+        bool aligned = e.offset % g_ArchiveMap.granularity == 0 &&
+            (e.size % g_ArchiveMap.pageSize == 0 || e.offset + e.size == g_ArchiveMap.fileSize);
+        if (!e.isLooseFile && e.size == e.decompressedSize && size <= e.size && aligned && !name && !g_ArchiveEncrypted &&
+            g_ArchiveMap.hMapping && (access == PAGE_READONLY || access == PAGE_WRITECOPY)) {
+            HANDLE dup = NULL;
+            if (DuplicateHandle(GetCurrentProcess(), g_ArchiveMap.hMapping, GetCurrentProcess(), &dup, 0,
+                sa && sa->bInheritHandle, DUPLICATE_SAME_ACCESS)) {
+                // A stale entry under the same value is replaced, not counted twice
+                std::lock_guard<std::mutex> directLock(g_DirectMutex);
+                if (g_DirectMappings.insert_or_assign(dup, DirectMapping{ e.offset, (DWORD)size }).second)
+                    InterlockedIncrement(&g_DirectObjects);
+                if (Config::EnableDebug) Utils::LogW(L"[VFS-Map] Direct section for %s", g_FileIndex.Path(e.index));
+                return dup;
+            }
+        }
+
+        // Everything else gets a pagefile-backed section holding the decoded contents. It is
+        // filled through a writable view, then handed out with read and copy rights only, so a
+        // read-only mapping faults on write and a writable one becomes copy-on-write, as it
+        // would be for the read-only file underneath.
+        NoteRowUsage(e.index, ServePolicy::USED_MAPPING, "CreateFileMapping");
+        bool execute = (access & (PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE | PAGE_EXECUTE_WRITECOPY)) != 0;
+        HANDLE hSection = CreateFileMappingW(INVALID_HANDLE_VALUE, sa, execute ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE,
+            (DWORD)(size >> 32), (DWORD)size, name);
+        if (!hSection || GetLastError() == ERROR_ALREADY_EXISTS) return hSection;
+        DWORD fill = (DWORD)min(size, (ULONGLONG)e.decompressedSize), br = 0;
+        BYTE* view = (BYTE*)MapViewOfFile(hSection, FILE_MAP_WRITE, 0, 0, 0);
+        if (view) {
+            LONGLONG saved = vfh->position;
+            vfh->position = 0;
+            ReadVirtualFile(h, view, fill, &br, NULL);
+            vfh->position = saved;
+            UnmapViewOfFile(view);
+        }
+        if (br != fill) {
+            if (g_RawCloseHandle) g_RawCloseHandle(hSection);
+            SetLastError(ERROR_READ_FAULT);
+            return NULL;
+        }
+        HANDLE hLimited = NULL;
+        DWORD rights = SECTION_QUERY | SECTION_MAP_READ | (execute ? SECTION_MAP_EXECUTE : 0);
+        if (!DuplicateHandle(GetCurrentProcess(), hSection, GetCurrentProcess(), &hLimited, rights,
+            sa && sa->bInheritHandle, DUPLICATE_CLOSE_SOURCE)) return NULL; // the source is closed either way
+        if (Config::EnableDebug) Utils::LogW(L"[VFS-Map] Filled %u byte section for %s", fill, g_FileIndex.Path(e.index));
+        SetLastError(ERROR_SUCCESS);
+        return hLimited;
+    }
+
+    bool TranslateDirectView(HANDLE hSection, LONGLONG& offset, SIZE_T& viewSize, LONGLONG& entryOffset, bool& outOfRange) {
+        if (g_DirectObjects == 0) return false;
+        std::lock_guard<std::mutex> lock(g_DirectMutex);
+        auto it = g_DirectMappings.find(hSection);
+        if (it == g_DirectMappings.end()) return false;
+        if (!IsArchiveSectionHandle(hSection)) {
+            if (Config::EnableDebug) Utils::Log("[VFS-Map] Dropped stale direct mapping %p", hSection);
+            g_DirectMappings.erase(it);
+            InterlockedDecrement(&g_DirectObjects);
+            return false;
+        }
+        const DirectMapping& m = it->second;
+        outOfRange = offset < 0 || (ULONGLONG)offset > m.size || viewSize > m.size - (ULONGLONG)offset;
+        if (outOfRange) return true;
+        if (viewSize == 0) viewSize = (SIZE_T)(m.size - offset);
+        entryOffset = m.offset;
+        offset += m.offset;
+        return true;
+    }
+
+    void ReleaseVirtualMapping(HANDLE hMapping) {
+        if (g_DirectObjects == 0) return;
+        std::lock_guard<std::mutex> lock(g_DirectMutex);
+        if (g_DirectMappings.erase(hMapping)) InterlockedDecrement(&g_DirectObjects);
+    }
+
     HANDLE VirtualFindFirstFileW(LPCWSTR lpFileName, LPWIN32_FIND_DATAW lpFindFileData) {
-        if (!g_IsActive) return g_OrigFindFirstFileW ? g_OrigFindFirstFileW(lpFileName, lpFindFileData) : INVALID_HANDLE_VALUE;
+        if (!WaitForIndex()) return g_OrigFindFirstFileW ? g_OrigFindFirstFileW(lpFileName, lpFindFileData) : INVALID_HANDLE_VALUE;
         
         wchar_t fPath[MAX_PATH]; 
-        if (!GetFullPathNameW(lpFileName, MAX_PATH, fPath, NULL)) return g_OrigFindFirstFileW(lpFileName, lpFindFileData);
+        if (!Hooks::GetFullPathW(lpFileName, fPath)) return g_OrigFindFirstFileW(lpFileName, lpFindFileData);
         
         std::wstring fstr = fPath; 
         size_t last = fstr.find_last_of(L"\\/");
@@ -475,64 +2417,64 @@ namespace VFS {
         std::wstring pattern = fstr.substr(last + 1);
         std::transform(pattern.begin(), pattern.end(), pattern.begin(), ::towlower);
 
-        auto state = std::make_unique<VirtualFindState>();
-        state->realHandle = g_OrigFindFirstFileW ? g_OrigFindFirstFileW(lpFileName, lpFindFileData) : INVALID_HANDLE_VALUE;
+        HANDLE hReal = g_OrigFindFirstFileW ? g_OrigFindFirstFileW(lpFileName, lpFindFileData) : INVALID_HANDLE_VALUE;
+        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
+        VirtualFindState* state = nullptr;
+        HANDLE hFake = g_FindTable.Alloc(&state);
+        if (hFake == INVALID_HANDLE_VALUE) return hReal;
+        state->realHandle = hReal;
         state->usingRealHandle = (state->realHandle != INVALID_HANDLE_VALUE);
         state->matchIndex = 0;
-        if (state->usingRealHandle) state->seenFiles.push_back(lpFindFileData->cFileName);
-
-        // Get game root directory to match relative paths
-        wchar_t gameRoot[MAX_PATH]; 
-        GetModuleFileNameW(NULL, gameRoot, MAX_PATH); 
-        PathRemoveFileSpecW(gameRoot);
-        std::wstring gameRootDir = NormalizePath(gameRoot);
+        if (state->usingRealHandle) state->seenFiles.insert(lpFindFileData->cFileName);
 
         // Find the relative directory within the game root
         std::wstring relDir;
-        if (sDir.length() >= gameRootDir.length() && _wcsnicmp(sDir.c_str(), gameRootDir.c_str(), gameRootDir.length()) == 0) {
-            relDir = sDir.substr(gameRootDir.length());
+        if (sDir.length() >= g_GameRootDir.length() && _wcsnicmp(sDir.c_str(), g_GameRootDir.c_str(), g_GameRootDir.length()) == 0) {
+            relDir = sDir.substr(g_GameRootDir.length());
             while (!relDir.empty() && relDir[0] == L'\\') relDir.erase(0, 1);
         } else {
             relDir = sDir; // Fallback
         }
 
-        std::lock_guard<std::recursive_mutex> lock(g_Mutex);
         auto itDir = g_DirectoryIndex.find(relDir);
         if (itDir != g_DirectoryIndex.end()) {
-            for (VFS::VirtualFileEntry* entry : itDir->second) {
-                const wchar_t* fileName = PathFindFileNameW(entry->relativePath.c_str());
-                if (PathMatchSpecW(fileName, pattern.c_str())) {
-                    state->matches.push_back(entry);
+            std::wstring suffix;
+            FindPatternKind kind = ClassifyFindPattern(pattern, suffix);
+            if (kind == FIND_MATCH_ALL) state->matches = itDir->second;
+            else {
+                for (DWORD row : itDir->second) {
+                    const wchar_t* fileName = PathFindFileNameW(g_FileIndex.Path(row));
+                    if (MatchFindPattern(fileName, kind, pattern, suffix)) state->matches.push_back(row);
                 }
             }
         }
 
-        if (state->matches.empty() && !state->usingRealHandle) { return INVALID_HANDLE_VALUE; }
+        if (state->matches.empty() && !state->usingRealHandle) { g_FindTable.Free(hFake); return INVALID_HANDLE_VALUE; }
         if (!state->usingRealHandle) {
-            VFS::VirtualFileEntry* m = state->matches[0];
-            wcscpy_s(lpFindFileData->cFileName, PathFindFileNameW(m->relativePath.c_str()));
-            lpFindFileData->nFileSizeLow = m->decompressedSize;
+            VFS::VirtualFileEntry m = g_FileIndex.Entry(state->matches[0]);
+            wcscpy_s(lpFindFileData->cFileName, PathFindFileNameW(g_FileIndex.Path(m.index)));
+            lpFindFileData->nFileSizeLow = m.decompressedSize;
+            lpFindFileData->ftCreationTime = lpFindFileData->ftLastAccessTime = lpFindFileData->ftLastWriteTime = m.lastWriteTime;
             lpFindFileData->dwFileAttributes = FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_READONLY;
             state->matchIndex++;
         }
-        HANDLE hFake = (HANDLE)(++g_VirtualHandleCounter);
-        g_FindMap[hFake] = std::move(state);
         return hFake;
     }
 
     BOOL VirtualFindNextFileW(HANDLE h, LPWIN32_FIND_DATAW fd) {
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_FindMap.find(h); if (it == g_FindMap.end()) return g_OrigFindNextFileW ? g_OrigFindNextFileW(h, fd) : FALSE;
-        VirtualFindState* s = it->second.get();
-        if (s->usingRealHandle && g_OrigFindNextFileW(s->realHandle, fd)) { s->seenFiles.push_back(fd->cFileName); return TRUE; }
+        VirtualFindState* s = g_FindTable.Get(h); if (!s) return g_OrigFindNextFileW ? g_OrigFindNextFileW(h, fd) : FALSE;
+        if (s->usingRealHandle && g_OrigFindNextFileW(s->realHandle, fd)) { s->seenFiles.insert(fd->cFileName); return TRUE; }
         s->usingRealHandle = false;
         while (s->matchIndex < s->matches.size()) {
-            VFS::VirtualFileEntry* m = s->matches[s->matchIndex++];
-            const wchar_t* name = PathFindFileNameW(m->relativePath.c_str());
-            bool seen = false; for (auto& f : s->seenFiles) if (_wcsicmp(f.c_str(), name) == 0) { seen = true; break; }
-            if (seen) continue;
+            DWORD row = s->matches[s->matchIndex++];
+            if (g_FileIndex.IsRemoved(row)) continue; // deleted by live reload since FindFirstFile
+            const wchar_t* name = PathFindFileNameW(g_FileIndex.Path(row));
+            if (!s->seenFiles.empty() && s->seenFiles.find(name) != s->seenFiles.end()) continue;
+            VFS::VirtualFileEntry m = g_FileIndex.Entry(row);
             wcscpy_s(fd->cFileName, name);
-            fd->nFileSizeLow = m->decompressedSize;
+            fd->nFileSizeLow = m.decompressedSize;
+            fd->ftCreationTime = fd->ftLastAccessTime = fd->ftLastWriteTime = m.lastWriteTime;
             fd->dwFileAttributes = FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_READONLY;
             return TRUE;
         }
@@ -541,9 +2483,9 @@ namespace VFS {
 
     BOOL VirtualFindClose(HANDLE h) {
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_FindMap.find(h); if (it == g_FindMap.end()) return g_OrigFindClose ? g_OrigFindClose(h) : FALSE;
-        if (it->second->realHandle != INVALID_HANDLE_VALUE && g_OrigFindClose) g_OrigFindClose(it->second->realHandle);
-        g_FindMap.erase(it); return TRUE;
+        VirtualFindState* s = g_FindTable.Get(h); if (!s) return g_OrigFindClose ? g_OrigFindClose(h) : FALSE;
+        if (s->realHandle != INVALID_HANDLE_VALUE && g_OrigFindClose) g_OrigFindClose(s->realHandle);
+        g_FindTable.Free(h); return TRUE;
     }
 
     HANDLE VirtualFindFirstFileA(LPCSTR n, LPWIN32_FIND_DATAA fd) {
@@ -567,28 +2509,34 @@ namespace VFS {
     }
 
     bool ExtractFile(const wchar_t* relativePath, const wchar_t* destPath) {
-        if (!g_IsActive || !relativePath || !destPath) return false;
+        if (!relativePath || !destPath || !WaitForIndex()) return false;
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        auto it = g_FileIndex.find(NormalizePath(relativePath)); if (it == g_FileIndex.end()) return false;
-        if (it->second.isLooseFile) return CopyFileW(it->second.looseFilePath.c_str(), destPath, FALSE);
+        DWORD row = g_FileIndex.Find(relativePath); if (row == FileIndex::kNone) return false;
+        if (g_FileIndex.IsLoose(row)) {
+            wchar_t loosePath[MAX_PATH];
+            return GetLoosePath(row, loosePath) && CopyFileW(loosePath, destPath, FALSE);
+        }
         if (g_ArchiveHandle == INVALID_HANDLE_VALUE) return false;
 
-        LARGE_INTEGER s; s.QuadPart = it->second.offset; g_RawSetFilePointerEx(g_ArchiveHandle, s, NULL, FILE_BEGIN);
-        std::vector<BYTE> buf(it->second.size); DWORD br; g_RawReadFile(g_ArchiveHandle, buf.data(), it->second.size, &br, NULL);
+        VirtualFileEntry entry = g_FileIndex.Entry(row);
+        const BYTE* data = nullptr; 
+        DWORD size = entry.size; 
+        std::vector<BYTE> dec, buf;
+        if (size < entry.decompressedSize) {
+            dec.resize(entry.decompressedSize);
+            if (DecodeEntry(entry, dec.data())) { 
+                data = dec.data(); 
+                size = entry.decompressedSize; 
+            }
+        }
+        if (!data) {
+            data = ReadArchiveBytes(entry.offset, entry.size, buf);
+            if (!data) return false;
+        }
         
         ScopedRawHandle hDest(g_RawCreateFileW(destPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL));
         if (hDest == INVALID_HANDLE_VALUE) return false;
 
-        const BYTE* data = buf.data(); 
-        DWORD size = it->second.size; 
-        std::vector<BYTE> dec;
-        if (size < it->second.decompressedSize) {
-            dec.resize(it->second.decompressedSize);
-            if (DecompressData(buf, it->second.decompressedSize, dec.data())) { 
-                data = dec.data(); 
-                size = it->second.decompressedSize; 
-            }
-        }
         DWORD bw; 
         WriteFile(hDest, data, size, &bw, NULL); 
         return bw == size;
@@ -596,6 +2544,8 @@ namespace VFS {
 
     void GetVirtualFileList(std::vector<std::wstring>& list) {
         std::lock_guard<std::recursive_mutex> lock(g_Mutex);
-        for (const auto& kv : g_FileIndex) list.push_back(kv.second.relativePath);
+        for (DWORD row = 0; row < g_FileIndex.Size(); row++) {
+            if (!g_FileIndex.IsRemoved(row)) list.push_back(g_FileIndex.Path(row));
+        }
     }
 }
@@ -4,38 +4,95 @@
 #include <unordered_map>
 #include <vector>
 #include <memory>
+#include "read_ahead.h"
 
 namespace VFS {
+    // One row of the file index, copied out by value. The path stays in the index's
+    // string arena and loose file locations are derived from the redirect folder.
     struct VirtualFileEntry {
-        std::wstring relativePath;
+        DWORD index;
         LONGLONG offset;
         DWORD size;
         DWORD decompressedSize;
         bool isLooseFile;
-        std::wstring looseFilePath;
+        FILETIME lastWriteTime;
+    };
+
+    struct VirtualFileInfo {
+        DWORD attributes;
+        ULONGLONG size;
+        FILETIME creationTime;
+        FILETIME lastAccessTime;
+        FILETIME lastWriteTime;
+    };
+
+    // Incremental decoder for entries Packer stored as independently compressed chunks.
+    // Only the chunk under the read position is kept decoded.
+    struct ChunkStream {
+        DWORD chunkSize;
+        std::vector<LONGLONG> chunkOffsets; // archive offsets, one past the last chunk included
+        DWORD decodedChunk;
+        std::vector<BYTE> decoded;
+
+        ChunkStream() : chunkSize(0), decodedChunk(MAXDWORD) {}
     };
 
     struct VirtualFileHandle {
-        const VirtualFileEntry* entry;
+        VirtualFileEntry entry;
         LONGLONG position;
         HANDLE archiveHandle;
         HANDLE looseFileHandle;
-        std::vector<BYTE> decompressedBuffer;
+        std::shared_ptr<const std::vector<BYTE>> decompressedBuffer;
+        std::unique_ptr<ChunkStream> stream;
         bool isLooseFile;
 
-        VirtualFileHandle() : entry(nullptr), position(0), archiveHandle(INVALID_HANDLE_VALUE), 
+        ReadAhead readAhead; // small reads that go to the file system
+
+        VirtualFileHandle() : entry(), position(0), archiveHandle(INVALID_HANDLE_VALUE), 
                             looseFileHandle(INVALID_HANDLE_VALUE), isLooseFile(false) {}
+
+        // Handle objects are pooled by the VFS; this returns one to the freshly constructed state
+        void Reset() {
+            entry = VirtualFileEntry(); position = 0;
+            archiveHandle = looseFileHandle = INVALID_HANDLE_VALUE;
+            decompressedBuffer.reset(); stream.reset(); isLooseFile = false;
+            readAhead.Reset();
+        }
     };
 
-    bool Initialize(HMODULE hModule);
+    // Starts building the index on a worker thread and returns at once, so DllMain does not
+    // wait for it.
+    void Initialize(HMODULE hModule);
     void Shutdown();
     bool IsActive();
+    // Blocks until the index is built and returns IsActive(). Under the loader lock the worker
+    // cannot have started, so the build runs on the calling thread instead.
+    bool WaitUntilReady();
     void SetOriginalFunctions(void* readFile, void* setFilePointerEx, void* closeHandle);
     void SetFindFunctions(void* findFirstW, void* findNextW, void* findClose, void* findFirstA, void* findNextA);
 
+    // Lock-free pre-checks for the hooks, taking the caller's path as passed. False means the
+    // path is certainly not virtual; true means it has to be resolved and looked up.
+    bool MayBeVirtual(const wchar_t* path);
+    bool MayBeVirtualA(const char* path);
+    bool MayContainVirtual(const wchar_t* findPattern);
+    bool MayContainVirtualA(const char* findPattern);
+    // Remembers on this thread that an absolute path resolved to nothing, until the index changes.
+    void NoteNotVirtual(const wchar_t* path);
+    void NoteNotVirtualA(const char* path);
+    // Reuse the row the path last given to MayBeVirtual(A) resolved to on this thread, skipping
+    // path resolution and lookup. INVALID_HANDLE_VALUE / false when it has to be resolved.
+    HANDLE OpenCachedVirtualFile();
+    bool GetCachedVirtualFileInfo(VirtualFileInfo* info);
+
     bool HasVirtualFile(const wchar_t* relativePath);
     bool HasVirtualFileA(const char* relativePath);
 
+    // Metadata straight from the index; never opens, reads or decompresses the entry.
+    bool GetVirtualFileInfo(const wchar_t* relativePath, VirtualFileInfo* info);
+    bool GetVirtualFileInfoA(const char* relativePath, VirtualFileInfo* info);
+
+    // Single lookup-and-open entry point: returns INVALID_HANDLE_VALUE if the path is not virtual.
     HANDLE OpenVirtualFile(const wchar_t* relativePath);
     HANDLE OpenVirtualFileA(const char* relativePath);
 
@@ -48,6 +105,18 @@ namespace VFS {
     BOOL CloseVirtualHandle(HANDLE hFile);
     BOOL GetVirtualFileInformationByHandle(HANDLE hFile, LPBY_HANDLE_FILE_INFORMATION lpFileInformation);
     DWORD GetVirtualFileType(HANDLE hFile);
+    // Automatic mode: an emulated handle reached an API the VFS does not emulate. The call
+    // still fails, but later opens of the entry are served with a real handle.
+    void NoteUnhookedUse(HANDLE hFile, const char* api);
+
+    // File mappings on emulated handles. Read-only mappings of aligned stored archive entries
+    // share the archive section (views are offset into it); anything else is a filled pagefile section.
+    HANDLE CreateVirtualFileMapping(HANDLE hFile, LPSECURITY_ATTRIBUTES lpAttributes, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR lpName);
+    // For a view of a shared archive section: moves offset to the entry's place in the archive
+    // and fills in a zero viewSize. Returns false when hSection is not one of ours; outOfRange
+    // is set when the view does not fit the entry.
+    bool TranslateDirectView(HANDLE hSection, LONGLONG& offset, SIZE_T& viewSize, LONGLONG& entryOffset, bool& outOfRange);
+    void ReleaseVirtualMapping(HANDLE hFileMappingObject);
 
     HANDLE VirtualFindFirstFileW(LPCWSTR lpFileName, LPWIN32_FIND_DATAW lpFindFileData);
     BOOL VirtualFindNextFileW(HANDLE hFindFile, LPWIN32_FIND_DATAW lpFindFileData);
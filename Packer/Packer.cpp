@@ -6,12 +6,22 @@
 #include <filesystem>
 #include <chrono>
 #include <iomanip>
+#include <random>
+#include "../Nepgear/hooks/cipher.h"
 
 #pragma comment(lib, "cabinet.lib")
 
 namespace fs = std::filesystem;
 
 COMPRESSOR_HANDLE g_compressor = NULL;
+std::string g_archiveKey; // UTF-8, empty = payloads are written unencrypted
+
+// Large files are packed as independently compressed chunks so the VFS can decode them
+// incrementally. Layout: magic, chunk size, chunk count, packed size of each chunk, chunks.
+// A chunk whose packed size equals its original size is stored uncompressed.
+const DWORD kChunkedMagic = 0x5A43504E; // "NPCZ"
+const size_t kChunkedThreshold = 8 * 1024 * 1024;
+const DWORD kChunkSize = 1024 * 1024;
 
 void SetColor(int colorCode) {
     SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), colorCode);
@@ -33,6 +43,17 @@ std::string WideToUtf8(const std::wstring& wstr) {
     return std::string(buf.data());
 }
 
+// Payloads are encrypted when a Nepgear.ini next to Packer.exe sets [FileRedirect] ArchiveKey,
+// the same key the game's Nepgear.ini needs to read the archive.
+std::string LoadArchiveKey() {
+    wchar_t exePath[MAX_PATH];
+    GetModuleFileNameW(NULL, exePath, MAX_PATH);
+    fs::path ini = fs::path(exePath).parent_path() / L"Nepgear.ini";
+    wchar_t key[256] = L"";
+    if (fs::exists(ini)) GetPrivateProfileStringW(L"FileRedirect", L"ArchiveKey", L"", key, 256, ini.c_str());
+    return WideToUtf8(key);
+}
+
 bool CompressData(const std::vector<char>& input, std::vector<char>& output) {
     if (g_compressor == NULL) {
         if (!CreateCompressor(COMPRESS_ALGORITHM_LZMS, NULL, &g_compressor)) return false;
@@ -53,6 +74,32 @@ bool CompressData(const std::vector<char>& input, std::vector<char>& output) {
     return true;
 }
 
+bool CompressChunked(const std::vector<char>& input, std::vector<char>& output) {
+    DWORD chunkCount = (DWORD)((input.size() + kChunkSize - 1) / kChunkSize);
+    std::vector<DWORD> packedSizes(chunkCount);
+    std::vector<char> payload;
+
+    for (DWORD i = 0; i < chunkCount; i++) {
+        size_t begin = (size_t)i * kChunkSize;
+        size_t len = (input.size() - begin < kChunkSize) ? input.size() - begin : kChunkSize;
+        std::vector<char> chunk(input.begin() + begin, input.begin() + begin + len);
+        std::vector<char> packed;
+        if (CompressData(chunk, packed) && packed.size() < len) {
+            payload.insert(payload.end(), packed.begin(), packed.end());
+            packedSizes[i] = (DWORD)packed.size();
+        } else {
+            payload.insert(payload.end(), chunk.begin(), chunk.end());
+            packedSizes[i] = (DWORD)len;
+        }
+    }
+
+    DWORD header[3] = { kChunkedMagic, kChunkSize, chunkCount };
+    output.assign((const char*)header, (const char*)header + sizeof(header));
+    output.insert(output.end(), (const char*)packedSizes.data(), (const char*)(packedSizes.data() + chunkCount));
+    output.insert(output.end(), payload.begin(), payload.end());
+    return true;
+}
+
 void DrawProgressBar(int current, int total, const std::wstring& currentFile) {
     const int barWidth = 30;
     float progress = (float)current / total;
@@ -102,6 +149,16 @@ bool PackDirectory(const fs::path& rootPath, const fs::path& outputPath) {
         return false;
     }
 
+    Cipher::Key key;
+    bool encrypt = !g_archiveKey.empty();
+    if (encrypt) {
+        std::random_device rd;
+        Cipher::ArchiveHeader header = { Cipher::kArchiveMagic, Cipher::kArchiveVersion, ((ULONGLONG)rd() << 32) | rd(), 0, 0 };
+        Cipher::DeriveKey(g_archiveKey.c_str(), header.salt, key);
+        header.keyCheck = Cipher::KeyCheck(key);
+        fwrite(&header, sizeof(header), 1, fpOut);
+    }
+
     int count = (int)filePaths.size();
     fwrite(&count, sizeof(int), 1, fpOut);
 
@@ -110,7 +167,10 @@ bool PackDirectory(const fs::path& rootPath, const fs::path& outputPath) {
     int processed = 0;
 
     std::wcout << L"目标文件: " << outputPath.filename().wstring() << L"\n";
-    std::wcout << L"文件总数: " << count << L"\n\n";
+    std::wcout << L"文件总数: " << count << L"\n";
+    std::wcout << L"加密方式: ";
+    if (encrypt) std::wcout << Cipher::KernelName() << L"\n\n";
+    else std::wcout << L"不加密\n\n";
 
     SetCursorVisible(false);
 
@@ -143,8 +203,11 @@ bool PackDirectory(const fs::path& rootPath, const fs::path& outputPath) {
             if (originalSize > 0) fread(inputBuffer.data(), 1, originalSize, fpIn);
             fclose(fpIn);
 
-            if (originalSize > 64 && CompressData(inputBuffer, compressedBuffer)) {
-                if (compressedBuffer.size() < (size_t)originalSize) {
+            if (originalSize > 64) {
+                bool ok = (size_t)originalSize > kChunkedThreshold
+                    ? CompressChunked(inputBuffer, compressedBuffer)
+                    : CompressData(inputBuffer, compressedBuffer);
+                if (ok && compressedBuffer.size() < (size_t)originalSize) {
                     compressed = true;
                 }
             }
@@ -154,8 +217,10 @@ bool PackDirectory(const fs::path& rootPath, const fs::path& outputPath) {
             fwrite(&originalSize, sizeof(int), 1, fpOut);
             fwrite(&finalSize, sizeof(int), 1, fpOut);
 
-            if (compressed) fwrite(compressedBuffer.data(), 1, finalSize, fpOut);
-            else if (originalSize > 0) fwrite(inputBuffer.data(), 1, originalSize, fpOut);
+            // The keystream is addressed by archive offset, so the VFS can decrypt any range
+            std::vector<char>& payload = compressed ? compressedBuffer : inputBuffer;
+            if (encrypt && finalSize > 0) Cipher::Apply(key, (ULONGLONG)_ftelli64(fpOut), (BYTE*)payload.data(), finalSize);
+            if (finalSize > 0) fwrite(payload.data(), 1, finalSize, fpOut);
         }
         else {
             int zero = 0;
@@ -191,6 +256,7 @@ bool PackDirectory(const fs::path& rootPath, const fs::path& outputPath) {
 int wmain(int argc, wchar_t* argv[]) {
     std::wcout.imbue(std::locale("", std::locale::all));
     SetConsoleTitleW(L"封包工具");
+    g_archiveKey = LoadArchiveKey();
 
     if (argc < 2) {
         SetColor(11);
@@ -0,0 +1,22 @@
+#pragma once
+// Timing helpers shared by the portable benchmarks.
+#include <chrono>
+#include <stdio.h>
+
+typedef std::chrono::steady_clock BenchClock;
+
+// Best of five runs of fn, in nanoseconds per operation.
+template <typename F> double BenchNsPerOp(size_t ops, F fn) {
+    fn(); // warm up
+    double best = 1e30;
+    for (int run = 0; run < 5; run++) {
+        BenchClock::time_point start = BenchClock::now();
+        fn();
+        double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+        if (ns < best) best = ns;
+    }
+    return best / (double)ops;
+}
+
+// Keeps results alive so the compiler cannot drop the measured work.
+extern volatile size_t g_BenchSink;
@@ -0,0 +1,75 @@
+// Throughput of the cipher kernels against a plain copy, the work a read does without
+// encryption. Run: cipher_bench [MiB]
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "cipher.cpp"
+
+typedef std::chrono::steady_clock Clock;
+
+static volatile BYTE g_Sink;
+
+template <typename F> static double Measure(size_t bytes, F fn) {
+    fn(); // warm up
+    double best = 1e30;
+    for (int run = 0; run < 5; run++) {
+        Clock::time_point start = Clock::now();
+        fn();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        if (seconds < best) best = seconds;
+    }
+    return bytes / best / (1024.0 * 1024.0 * 1024.0);
+}
+
+int main(int argc, char** argv) {
+    size_t mib = argc > 1 ? (size_t)atoi(argv[1]) : 64;
+    size_t size = mib << 20;
+    std::vector<BYTE> src(size), dst(size);
+    for (size_t i = 0; i < size; i++) src[i] = (BYTE)i;
+    Cipher::Key key;
+    Cipher::DeriveKey("benchmark", 1, key);
+
+    printf("buffer %zu MiB, active kernel %s, GiB/s (best of 5)\n", mib, Cipher::KernelName());
+    double copy = Measure(size, [&] { memcpy(dst.data(), src.data(), size); g_Sink = dst[size / 2]; });
+    printf("  %-22s %6.2f\n", "copy", copy);
+
+    struct { const char* name; XorBlocksFn fn; bool usable; } kernels[] = {
+        { "scalar", XorBlocksScalar, true },
+        { "SSE2", XorBlocksSSE2, true },
+        { "AVX2", XorBlocksAVX2, CpuHasAVX2() },
+    };
+    for (auto& k : kernels) {
+        if (!k.usable) continue;
+        double xorOnly = Measure(size, [&] { k.fn(key, 0, dst.data(), size / 64); g_Sink = dst[size / 2]; });
+        double copyXor = Measure(size, [&] {
+            memcpy(dst.data(), src.data(), size);
+            k.fn(key, 0, dst.data(), size / 64);
+            g_Sink = dst[size / 2];
+        });
+        printf("  %-22s %6.2f   copy+xor %6.2f  (%.1fx the time of a copy)\n", k.name, xorOnly, copyXor, copy / copyXor);
+    }
+
+    // A read served in 64 KiB pieces at unaligned archive offsets, as ReadFile sees it
+    const size_t piece = 64 * 1024 + 5;
+    double reads = Measure(size, [&] {
+        for (size_t pos = 0; pos < size; pos += piece) {
+            size_t n = min(piece, size - pos);
+            memcpy(dst.data() + pos, src.data() + pos, n);
+            Cipher::Apply(key, 3 + pos, dst.data() + pos, n);
+        }
+        g_Sink = dst[size / 2];
+    });
+    printf("  %-22s %6.2f   (%.1fx the time of a copy)\n", "Apply, 64 KiB reads", reads, copy / reads);
+
+    // The same reads once the entry sits decrypted in the decoded cache: only the copy is left
+    std::vector<BYTE> decrypted(src);
+    Cipher::Apply(key, 3, decrypted.data(), size);
+    double cached = Measure(size, [&] {
+        for (size_t pos = 0; pos < size; pos += piece) memcpy(dst.data() + pos, decrypted.data() + pos, min(piece, size - pos));
+        g_Sink = dst[size / 2];
+    });
+    printf("  %-22s %6.2f   (%.2fx the time of a copy)\n", "decoded cache reads", cached, copy / cached);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+// Straightforward ChaCha8 written from the specification, kept independent of cipher.cpp
+// so the kernels are checked against something other than themselves.
+#include <stdint.h>
+#include <string.h>
+
+inline uint32_t RefRotl(uint32_t v, int n) { return (v << n) | (v >> (32 - n)); }
+
+inline void RefQuarter(uint32_t* x, int a, int b, int c, int d) {
+    x[a] += x[b]; x[d] = RefRotl(x[d] ^ x[a], 16);
+    x[c] += x[d]; x[b] = RefRotl(x[b] ^ x[c], 12);
+    x[a] += x[b]; x[d] = RefRotl(x[d] ^ x[a], 8);
+    x[c] += x[d]; x[b] = RefRotl(x[b] ^ x[c], 7);
+}
+
+// One 64-byte keystream block: 256-bit key, 64-bit block counter, 64-bit nonce.
+inline void RefBlock(const uint32_t key[8], uint64_t nonce, uint64_t counter, uint8_t out[64]) {
+    static const uint8_t sigma[17] = "expand 32-byte k";
+    uint32_t s[16], x[16];
+    for (int i = 0; i < 4; i++)
+        s[i] = sigma[4 * i] | sigma[4 * i + 1] << 8 | sigma[4 * i + 2] << 16 | (uint32_t)sigma[4 * i + 3] << 24;
+    for (int i = 0; i < 8; i++) s[4 + i] = key[i];
+    s[12] = (uint32_t)counter; s[13] = (uint32_t)(counter >> 32);
+    s[14] = (uint32_t)nonce; s[15] = (uint32_t)(nonce >> 32);
+    memcpy(x, s, sizeof(x));
+    for (int r = 0; r < 8; r += 2) {
+        RefQuarter(x, 0, 4, 8, 12); RefQuarter(x, 1, 5, 9, 13); RefQuarter(x, 2, 6, 10, 14); RefQuarter(x, 3, 7, 11, 15);
+        RefQuarter(x, 0, 5, 10, 15); RefQuarter(x, 1, 6, 11, 12); RefQuarter(x, 2, 7, 8, 13); RefQuarter(x, 3, 4, 9, 14);
+    }
+    for (int i = 0; i < 16; i++) {
+        uint32_t v = x[i] + s[i];
+        out[4 * i] = (uint8_t)v; out[4 * i + 1] = (uint8_t)(v >> 8);
+        out[4 * i + 2] = (uint8_t)(v >> 16); out[4 * i + 3] = (uint8_t)(v >> 24);
+    }
+}
+
+// XORs the keystream for stream bytes [offset, offset + size) into data.
+inline void RefApply(const uint32_t key[8], uint64_t nonce, uint64_t offset, uint8_t* data, size_t size) {
+    uint8_t ks[64];
+    for (size_t i = 0; i < size; i++) {
+        uint64_t pos = offset + i;
+        if (i == 0 || pos % 64 == 0) RefBlock(key, nonce, pos / 64, ks);
+        data[i] ^= ks[pos % 64];
+    }
+}
@@ -0,0 +1,117 @@
+#include "test.h"
+#include "cipher_reference.h"
+#include <vector>
+
+// Built as part of this translation unit so the individual kernels can be called directly.
+#include "cipher.cpp"
+
+static Cipher::Key TestKey(ULONGLONG salt) {
+    Cipher::Key key;
+    Cipher::DeriveKey("nepgear test key", salt, key);
+    return key;
+}
+
+static std::vector<BYTE> Pattern(size_t size) {
+    std::vector<BYTE> v(size);
+    for (size_t i = 0; i < size; i++) v[i] = (BYTE)(i * 131 + 7);
+    return v;
+}
+
+static bool MatchesReference(XorBlocksFn fn, const Cipher::Key& key, ULONGLONG counter, size_t blocks) {
+    std::vector<BYTE> data = Pattern(blocks * 64), expect = data;
+    size_t done = fn(key, counter, data.data(), blocks);
+    RefApply(key.words, key.salt, counter * 64, expect.data(), done * 64);
+    return memcmp(data.data(), expect.data(), data.size()) == 0;
+}
+
+TEST(KnownAnswer) {
+    // ChaCha8, 256-bit all-zero key and nonce, first keystream block
+    static const BYTE expect[64] = {
+        0x3e, 0x00, 0xef, 0x2f, 0x89, 0x5f, 0x40, 0xd6, 0x7f, 0x5b, 0xb8, 0xe8, 0x1f, 0x09, 0xa5, 0xa1,
+        0x2c, 0x84, 0x0e, 0xc3, 0xce, 0x9a, 0x7f, 0x3b, 0x18, 0x1b, 0xe1, 0x88, 0xef, 0x71, 0x1a, 0x1e,
+        0x98, 0x4c, 0xe1, 0x72, 0xb9, 0x21, 0x6f, 0x41, 0x9f, 0x44, 0x53, 0x67, 0x45, 0x6d, 0x56, 0x19,
+        0x31, 0x4a, 0x42, 0xa3, 0xda, 0x86, 0xb0, 0x01, 0x38, 0x7b, 0xfd, 0xb8, 0x0e, 0x0c, 0xfe, 0x42 };
+    Cipher::Key zero = {};
+    BYTE block[64];
+    Block(zero, 0, block);
+    CHECK(memcmp(block, expect, 64) == 0);
+    BYTE ref[64];
+    RefBlock(zero.words, 0, 0, ref);
+    CHECK(memcmp(ref, expect, 64) == 0);
+}
+
+TEST(ScalarKernel) {
+    Cipher::Key key = TestKey(0x0123456789ABCDEFULL);
+    CHECK(MatchesReference(XorBlocksScalar, key, 0, 17));
+    CHECK(MatchesReference(XorBlocksScalar, key, 0xFFFFFFFEULL, 5)); // low counter word wraps
+}
+
+TEST(SSE2Kernel) {
+    Cipher::Key key = TestKey(42);
+    CHECK_EQ(XorBlocksSSE2(key, 0, nullptr, 3), (size_t)0);
+    CHECK(MatchesReference(XorBlocksSSE2, key, 0, 4));
+    CHECK(MatchesReference(XorBlocksSSE2, key, 9, 64));
+    CHECK(MatchesReference(XorBlocksSSE2, key, 0xFFFFFFFEULL, 8));
+}
+
+TEST(AVX2Kernel) {
+    if (!CpuHasAVX2()) { printf("  AVX2 not available, skipped\n"); return; }
+    Cipher::Key key = TestKey(42);
+    CHECK_EQ(XorBlocksAVX2(key, 0, nullptr, 7), (size_t)0);
+    CHECK(MatchesReference(XorBlocksAVX2, key, 0, 8));
+    CHECK(MatchesReference(XorBlocksAVX2, key, 3, 64));
+    CHECK(MatchesReference(XorBlocksAVX2, key, 0xFFFFFFFCULL, 16));
+}
+
+TEST(ApplyArbitraryRanges) {
+    Cipher::Key key = TestKey(7);
+    const ULONGLONG offsets[] = { 0, 1, 63, 64, 65, 1000, 0x3FFFFFFFC0ULL - 5 };
+    const size_t sizes[] = { 0, 1, 63, 64, 65, 255, 256, 511, 513, 4096 + 17 };
+    for (ULONGLONG offset : offsets) {
+        for (size_t size : sizes) {
+            std::vector<BYTE> data = Pattern(size), expect = data;
+            Cipher::Apply(key, offset, data.data(), size);
+            RefApply(key.words, key.salt, offset, expect.data(), size);
+            if (memcmp(data.data(), expect.data(), size) != 0) {
+                CHECK(!"Apply differs from the reference");
+                printf("  offset %llu size %zu\n", (unsigned long long)offset, size);
+            }
+        }
+    }
+}
+
+TEST(ApplyIsPositional) {
+    // Decrypting a range in pieces gives the same bytes as decrypting it at once
+    Cipher::Key key = TestKey(99);
+    std::vector<BYTE> whole = Pattern(10000), pieces = whole;
+    Cipher::Apply(key, 12345, whole.data(), whole.size());
+    size_t cuts[] = { 0, 1, 70, 640, 641, 5000, 9999, 10000 };
+    for (int i = 0; i + 1 < 8; i++)
+        Cipher::Apply(key, 12345 + cuts[i], pieces.data() + cuts[i], cuts[i + 1] - cuts[i]);
+    CHECK(whole == pieces);
+    Cipher::Apply(key, 12345, whole.data(), whole.size());
+    CHECK(whole == Pattern(10000));
+}
+
+TEST(KeyDerivation) {
+    Cipher::Key a, b, c, d;
+    Cipher::DeriveKey("secret", 1, a);
+    Cipher::DeriveKey("secret", 1, b);
+    Cipher::DeriveKey("secret", 2, c);
+    Cipher::DeriveKey("Secret", 1, d);
+    CHECK(memcmp(a.words, b.words, sizeof(a.words)) == 0);
+    CHECK_EQ(Cipher::KeyCheck(a), Cipher::KeyCheck(b));
+    CHECK(Cipher::KeyCheck(a) != Cipher::KeyCheck(d));
+    CHECK(memcmp(a.words, d.words, sizeof(a.words)) != 0);
+    CHECK_EQ(a.salt, (ULONGLONG)1);
+    CHECK_EQ(c.salt, (ULONGLONG)2);
+    // Passphrases longer than one 32-byte chunk use every byte
+    Cipher::DeriveKey("0123456789abcdef0123456789abcdefX", 1, a);
+    Cipher::DeriveKey("0123456789abcdef0123456789abcdefY", 1, b);
+    CHECK(memcmp(a.words, b.words, sizeof(a.words)) != 0);
+}
+
+int main() {
+    printf("active kernel: %s\n", Cipher::KernelName());
+    return RunTests();
+}
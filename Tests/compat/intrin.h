@@ -0,0 +1,8 @@
+#pragma once
+// GCC/Clang spellings of the MSVC intrinsics the VFS sources use. <cpuid.h> already
+// provides __cpuidex, and _xgetbv comes with -mxsave.
+#include <cpuid.h>
+#include <x86intrin.h>
+
+#undef __cpuid
+inline void __cpuid(int r[4], int leaf) { __cpuid_count(leaf, 0, r[0], r[1], r[2], r[3]); }
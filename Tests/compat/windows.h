@@ -0,0 +1,26 @@
+#pragma once
+// Just enough of <windows.h> to build the platform-independent VFS sources on Linux.
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && !defined(_WIN64)
+#define _WIN64
+#endif
+
+typedef uint8_t BYTE;
+typedef uint32_t DWORD;
+typedef uint64_t ULONGLONG;
+typedef int64_t LONGLONG;
+typedef int BOOL;
+
+#define MAX_PATH 260
+#define PF_XMMI64_INSTRUCTIONS_AVAILABLE 10
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+inline BOOL IsProcessorFeaturePresent(DWORD) { return 1; }
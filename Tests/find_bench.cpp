@@ -0,0 +1,72 @@
+// FindNextFile de-duplication of virtual entries against names the real search returned.
+// Before: every virtual name was compared against a vector of the real names. After: an
+// unordered_set with the index's PathHash/PathEqual, as VirtualFindState::seenFiles uses.
+#include "bench.h"
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <wctype.h>
+#include "path_key.h"
+
+volatile size_t g_BenchSink;
+
+static int CompareNoCase(const wchar_t* a, const wchar_t* b) {
+    while (*a && towlower(*a) == towlower(*b)) { a++; b++; }
+    return (int)towlower(*a) - (int)towlower(*b);
+}
+
+// One enumeration of a directory holding `real` files on disk and `virt` in the index,
+// half of which shadow a real file. Returns the number of virtual names reported.
+static size_t EnumerateBefore(const std::vector<std::wstring>& realNames, const std::vector<std::wstring>& virtNames) {
+    std::vector<std::wstring> seen;
+    for (const auto& n : realNames) seen.push_back(n);
+    size_t reported = 0;
+    for (const auto& name : virtNames) {
+        bool dup = false;
+        for (auto& f : seen) if (CompareNoCase(f.c_str(), name.c_str()) == 0) { dup = true; break; }
+        if (!dup) reported++;
+    }
+    return reported;
+}
+
+static size_t EnumerateAfter(const std::vector<std::wstring>& realNames, const std::vector<std::wstring>& virtNames) {
+    std::unordered_set<std::wstring, PathHash, PathEqual> seen;
+    for (const auto& n : realNames) seen.insert(n);
+    size_t reported = 0;
+    for (const auto& name : virtNames) {
+        if (!seen.empty() && seen.find(name) != seen.end()) continue;
+        reported++;
+    }
+    return reported;
+}
+
+static double MillisecondsOnce(size_t (*fn)(const std::vector<std::wstring>&, const std::vector<std::wstring>&),
+                               const std::vector<std::wstring>& realNames, const std::vector<std::wstring>& virtNames) {
+    BenchClock::time_point start = BenchClock::now();
+    g_BenchSink = fn(realNames, virtNames);
+    return std::chrono::duration<double, std::milli>(BenchClock::now() - start).count();
+}
+
+int main() {
+    const size_t sizes[] = { 1000, 5000, 20000, 100000 };
+    printf("entries per side, ms per full enumeration (half the virtual names shadow real ones)\n");
+    printf("  %8s %12s %12s\n", "entries", "before", "after");
+    for (size_t n : sizes) {
+        std::vector<std::wstring> realNames, virtNames;
+        for (size_t i = 0; i < n; i++) {
+            wchar_t name[64];
+            swprintf(name, 64, L"V%06zu.OGG", i);
+            realNames.push_back(name);
+            swprintf(name, 64, L"v%06zu.ogg", i + n / 2);
+            virtNames.push_back(name);
+        }
+        double after = BenchNsPerOp(1, [&] { g_BenchSink = EnumerateAfter(realNames, virtNames); }) / 1e6;
+        if (n <= 20000) {
+            double before = MillisecondsOnce(EnumerateBefore, realNames, virtNames);
+            printf("  %8zu %12.1f %12.2f\n", n, before, after);
+        } else {
+            printf("  %8zu %12s %12.2f\n", n, "(quadratic)", after);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,74 @@
+// Per-CreateFile cost of the index lookup. Before: HasVirtualFile and OpenVirtualFile each
+// built a normalized std::wstring and probed a std::wstring-keyed map. After: one lookup
+// with PathHash/PathEqual folding the caller's buffer in place.
+#include "bench.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "path_key.h"
+
+volatile size_t g_BenchSink;
+
+struct Entry {
+    long long offset;
+    DWORD size;
+};
+
+// NormalizePath as it was before the change
+static std::wstring NormalizeCopy(const wchar_t* path) {
+    std::wstring normalized;
+    normalized.reserve(MAX_PATH);
+    const wchar_t* p = path;
+    while (*p == L'\\' || *p == L'/') p++;
+    for (; *p != L'\0'; ++p) normalized += FoldPathChar(*p);
+    return normalized;
+}
+
+int main() {
+    const size_t files = 50000;
+    std::unordered_map<std::wstring, Entry> before;
+    std::unordered_map<std::wstring, Entry, PathHash, PathEqual> after;
+    std::vector<std::wstring> queries;
+    for (size_t i = 0; i < files; i++) {
+        wchar_t path[MAX_PATH];
+        swprintf(path, MAX_PATH, L"data\\voice\\ch%02zu\\v%06zu.ogg", i % 40, i);
+        before[path] = { (long long)i * 4096, 4096 };
+        after[path] = { (long long)i * 4096, 4096 };
+        // What the hooks pass: the caller's spelling, relative to the game root
+        swprintf(path, MAX_PATH, L"Data/Voice/CH%02zu\\V%06zu.OGG", i % 40, (i * 7919) % files);
+        queries.push_back(path);
+        if (i % 4 == 0) { // misses: same directories, names the index does not have
+            swprintf(path, MAX_PATH, L"data\\voice\\ch%02zu\\x%06zu.ogg", i % 40, i);
+            queries.push_back(path);
+        }
+    }
+
+    double oneBefore = BenchNsPerOp(queries.size(), [&] {
+        size_t hits = 0;
+        for (const auto& q : queries) hits += before.find(NormalizeCopy(q.c_str())) != before.end();
+        g_BenchSink = hits;
+    });
+    double twoBefore = BenchNsPerOp(queries.size(), [&] {
+        size_t hits = 0;
+        for (const auto& q : queries) {
+            if (before.find(NormalizeCopy(q.c_str())) == before.end()) continue; // HasVirtualFile
+            auto it = before.find(NormalizeCopy(q.c_str())); // OpenVirtualFile
+            hits += it->second.size;
+        }
+        g_BenchSink = hits;
+    });
+    double oneAfter = BenchNsPerOp(queries.size(), [&] {
+        size_t hits = 0;
+        for (const auto& q : queries) {
+            auto it = after.find(q.c_str());
+            if (it != after.end()) hits += it->second.size;
+        }
+        g_BenchSink = hits;
+    });
+
+    printf("%zu indexed files, %zu lookups (20%% misses), ns per CreateFile (best of 5)\n", files, queries.size());
+    printf("  before, normalize + lookup, twice   %7.1f\n", twoBefore);
+    printf("  before, normalize + lookup, once    %7.1f\n", oneBefore);
+    printf("  after, folded in place, once        %7.1f  (%.1fx faster)\n", oneAfter, twoBefore / oneAfter);
+    return 0;
+}
@@ -0,0 +1,115 @@
+#include "test.h"
+#include "path_canon.h"
+#include <string>
+
+static const char* kCwd = "C:\\Games\\Title";
+
+// Returns the resolved path, or "<fallback>" when CanonicalizePath declines.
+static std::string Resolve(const char* path, const char* cwd = kCwd) {
+    char out[MAX_PATH];
+    return CanonicalizePath(path, cwd, out) ? out : "<fallback>";
+}
+
+static std::wstring ResolveW(const wchar_t* path, const wchar_t* cwd) {
+    wchar_t out[MAX_PATH];
+    return CanonicalizePath(path, cwd, out) ? out : L"<fallback>";
+}
+
+TEST(DriveAbsolute) {
+    CHECK_EQ(Resolve("C:\\Games\\Title\\data.xp3"), "C:\\Games\\Title\\data.xp3");
+    CHECK_EQ(Resolve("D:\\"), "D:\\");
+    CHECK_EQ(Resolve("c:\\a"), "c:\\a"); // case is kept; the callers compare case-insensitively
+}
+
+TEST(CwdRelative) {
+    CHECK_EQ(Resolve("data\\bg.png"), "C:\\Games\\Title\\data\\bg.png");
+    CHECK_EQ(Resolve(".\\data\\.\\bg.png"), "C:\\Games\\Title\\data\\bg.png");
+    CHECK_EQ(Resolve("bg.png", "C:\\Games\\Title\\"), "C:\\Games\\Title\\bg.png");
+    CHECK_EQ(Resolve("bg.png", "C:\\"), "C:\\bg.png");
+    CHECK_EQ(Resolve(""), "C:\\Games\\Title");
+}
+
+TEST(Rooted) {
+    CHECK_EQ(Resolve("\\Windows\\win.ini"), "C:\\Windows\\win.ini");
+    CHECK_EQ(Resolve("/Windows/win.ini"), "C:\\Windows\\win.ini");
+}
+
+TEST(DotDot) {
+    CHECK_EQ(Resolve("..\\Other\\a.txt"), "C:\\Games\\Other\\a.txt");
+    CHECK_EQ(Resolve("C:\\a\\b\\..\\c"), "C:\\a\\c");
+    CHECK_EQ(Resolve("data\\.."), "C:\\Games\\Title");
+}
+
+TEST(DotDotAboveRoot) {
+    CHECK_EQ(Resolve("C:\\..\\a"), "C:\\a");
+    CHECK_EQ(Resolve("C:\\..\\..\\..\\"), "C:\\");
+    CHECK_EQ(Resolve("..\\..\\..\\..\\x"), "C:\\x");
+    CHECK_EQ(Resolve("\\.."), "C:\\");
+}
+
+TEST(DriveRelativeFallsBack) {
+    CHECK_EQ(Resolve("C:foo"), "<fallback>");
+    CHECK_EQ(Resolve("C:"), "<fallback>");
+    CHECK_EQ(Resolve("D:..\\x"), "<fallback>");
+}
+
+TEST(UncAndDevicePathsFallBack) {
+    CHECK_EQ(Resolve("\\\\server\\share\\a.txt"), "<fallback>");
+    CHECK_EQ(Resolve("//server/share/a.txt"), "<fallback>");
+    CHECK_EQ(Resolve("\\\\?\\C:\\Games\\a.txt"), "<fallback>");
+    CHECK_EQ(Resolve("\\\\.\\PhysicalDrive0"), "<fallback>");
+    CHECK_EQ(Resolve("a.txt", "\\\\server\\share"), "<fallback>"); // cwd on a share
+    CHECK_EQ(Resolve("a.txt", ""), "<fallback>");
+}
+
+TEST(MixedSeparators) {
+    CHECK_EQ(Resolve("C:/Games\\Title/data\\bg.png"), "C:\\Games\\Title\\data\\bg.png");
+    CHECK_EQ(Resolve("data/sub\\file"), "C:\\Games\\Title\\data\\sub\\file");
+}
+
+TEST(RepeatedSeparators) {
+    CHECK_EQ(Resolve("C:\\\\Games\\\\\\Title//data"), "C:\\Games\\Title\\data");
+    CHECK_EQ(Resolve("data\\\\bg.png\\"), "C:\\Games\\Title\\data\\bg.png");
+    CHECK_EQ(Resolve("x", "C:\\Games\\\\"), "C:\\Games\\x");
+}
+
+TEST(TrailingDotsAndSpacesFallBack) {
+    CHECK_EQ(Resolve("data\\bg.png."), "<fallback>");
+    CHECK_EQ(Resolve("data\\bg.png "), "<fallback>");
+    CHECK_EQ(Resolve("data.\\bg.png"), "<fallback>");
+    CHECK_EQ(Resolve("...\\bg.png"), "<fallback>");
+}
+
+TEST(StreamsFallBack) {
+    CHECK_EQ(Resolve("data\\bg.png:stream"), "<fallback>");
+}
+
+TEST(NonAsciiNarrowFallsBack) {
+    CHECK_EQ(Resolve("\x83\x5C.txt"), "<fallback>"); // Shift-JIS lead byte with a 0x5C trail
+    CHECK_EQ(Resolve("a.txt", "C:\\\x83\x5C"), "<fallback>");
+}
+
+TEST(Wide) {
+    CHECK(ResolveW(L"data/\u753b\u50cf.png", L"C:\\Games") == L"C:\\Games\\data\\\u753b\u50cf.png");
+    CHECK(ResolveW(L"\\\\?\\C:\\a", L"C:\\Games") == L"<fallback>");
+}
+
+TEST(OutputExceedingMaxPath) {
+    // The 14-character cwd plus a separator leaves MAX_PATH - 16 characters for the name
+    std::string fits(MAX_PATH - 16, 'a');
+    CHECK_EQ(Resolve(fits.c_str()).size(), (size_t)MAX_PATH - 1);
+    std::string tooLong(MAX_PATH - 15, 'a');
+    CHECK_EQ(Resolve(tooLong.c_str()), "<fallback>");
+    // Many short components that only overflow together
+    std::string deep;
+    for (int i = 0; i < 100; i++) deep += "ab\\";
+    CHECK_EQ(Resolve(deep.c_str()), "<fallback>");
+    // An intermediate result over the limit falls back even if '..' would shorten it again
+    std::string back = tooLong + "\\..\\x";
+    CHECK_EQ(Resolve(back.c_str()), "<fallback>");
+    // The cwd alone may not overflow the output either
+    std::string longCwd = "C:\\" + std::string(MAX_PATH + 10, 'c');
+    CHECK_EQ(Resolve("x", longCwd.c_str()), "<fallback>");
+}
+
+int main() { return RunTests(); }
@@ -0,0 +1,68 @@
+// System calls behind small sequential reads of a loose or stored entry. Each fetch from the
+// source is a SetFilePointerEx plus a ReadFile; without read-ahead every read is one fetch.
+#include "bench.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "read_ahead.h"
+
+volatile size_t g_BenchSink;
+
+struct Read {
+    LONGLONG pos;
+    DWORD size;
+};
+
+// A parser walking records: 4-byte length, 16-byte header, then the body. Bodies are read
+// in one call, and every 64th record is skipped with a seek.
+static std::vector<Read> RecordWalk(LONGLONG fileSize) {
+    std::vector<Read> reads;
+    srand(1);
+    LONGLONG pos = 0;
+    for (int record = 0; pos + 20 < fileSize; record++) {
+        DWORD body = 32 + rand() % 2048;
+        if (record % 64 == 63) body = 128 * 1024; // an occasional large blob
+        reads.push_back({ pos, 4 });
+        reads.push_back({ pos + 4, 16 });
+        pos += 20;
+        if (pos + body > fileSize) body = (DWORD)(fileSize - pos);
+        if (record % 64 != 31) reads.push_back({ pos, body });
+        pos += body;
+    }
+    return reads;
+}
+
+int main() {
+    const LONGLONG fileSize = 16 << 20;
+    std::vector<BYTE> file((size_t)fileSize);
+    for (size_t i = 0; i < file.size(); i++) file[i] = (BYTE)(i * 2654435761u >> 24);
+    std::vector<Read> reads = RecordWalk(fileSize);
+
+    size_t fetches = 0, bytesFetched = 0;
+    ReadAhead readAhead;
+    std::vector<BYTE> out(256 * 1024);
+    for (const Read& r : reads) {
+        DWORD br = readAhead.Read(r.pos, out.data(), r.size, fileSize, [&](LONGLONG pos, BYTE* dst, DWORD len) {
+            fetches++;
+            DWORD n = (DWORD)(len < fileSize - pos ? len : fileSize - pos);
+            memcpy(dst, file.data() + pos, n);
+            bytesFetched += n;
+            return n;
+        });
+        if (br != r.size || memcmp(out.data(), file.data() + r.pos, br) != 0) {
+            printf("read at %lld returned the wrong bytes\n", (long long)r.pos);
+            return 1;
+        }
+    }
+
+    size_t bytesRead = 0;
+    for (const Read& r : reads) bytesRead += r.size;
+    printf("%lld MiB entry, %zu reads (4 and 16 byte fields, 32 B-2 KiB bodies, some 128 KiB blobs)\n",
+        (long long)(fileSize >> 20), reads.size());
+    printf("  %-18s %8s %10s %12s\n", "", "fetches", "syscalls", "bytes read");
+    printf("  %-18s %8zu %10zu %12zu\n", "without read-ahead", reads.size(), reads.size() * 2, bytesRead);
+    printf("  %-18s %8zu %10zu %12zu\n", "with read-ahead", fetches, fetches * 2, bytesFetched);
+    printf("  %.1fx fewer system calls\n", (double)reads.size() / fetches);
+    g_BenchSink = fetches;
+    return 0;
+}
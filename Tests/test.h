@@ -0,0 +1,59 @@
+#pragma once
+// Minimal self-registering test harness for the portable tests.
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+struct TestCase {
+    const char* name;
+    void (*fn)();
+};
+
+inline std::vector<TestCase>& TestRegistry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+inline int& TestFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+struct TestRegistrar {
+    TestRegistrar(const char* name, void (*fn)()) { TestRegistry().push_back({ name, fn }); }
+};
+
+#define TEST(name) \
+    static void Test_##name(); \
+    static TestRegistrar g_Register_##name(#name, Test_##name); \
+    static void Test_##name()
+
+#define CHECK(cond) \
+    do { if (!(cond)) { TestFailures()++; printf("  %s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } } while (0)
+
+template <typename A, typename B> inline bool CheckEqual(const A& a, const B& b, const char* expr, const char* file, int line) {
+    if (a == b) return true;
+    TestFailures()++;
+    printf("  %s:%d: %s differs\n", file, line, expr);
+    return false;
+}
+inline bool CheckEqual(const std::string& a, const char* b, const char* expr, const char* file, int line) {
+    if (a == b) return true;
+    TestFailures()++;
+    printf("  %s:%d: %s: got \"%s\", expected \"%s\"\n", file, line, expr, a.c_str(), b);
+    return false;
+}
+#define CHECK_EQ(a, b) CheckEqual((a), (b), #a, __FILE__, __LINE__)
+
+inline int RunTests() {
+    int failedTests = 0;
+    for (const auto& t : TestRegistry()) {
+        int before = TestFailures();
+        t.fn();
+        bool ok = TestFailures() == before;
+        if (!ok) failedTests++;
+        printf("[%s] %s\n", ok ? " OK " : "FAIL", t.name);
+    }
+    printf("%zu tests, %d failed\n", TestRegistry().size(), failedTests);
+    return failedTests ? 1 : 0;
+}
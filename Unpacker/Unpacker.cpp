@@ -13,6 +13,9 @@ namespace fs = std::filesystem;
 
 DECOMPRESSOR_HANDLE g_decompressor = NULL;
 
+const DWORD kChunkedMagic = 0x5A43504E; // "NPCZ", see Packer
+const DWORD kEncryptedMagic = 0x4543504E; // "NPCE", archives packed with an ArchiveKey
+
 void SetColor(int colorCode) {
     SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), colorCode);
 }
@@ -43,6 +46,40 @@ bool DecompressLZMS(const std::vector<char>& input, std::vector<char>& output, s
     return Decompress(g_decompressor, input.data(), input.size(), output.data(), originalSize, &decompressedSize);
 }
 
+bool DecompressChunked(const std::vector<char>& input, std::vector<char>& output, size_t originalSize) {
+    if (input.size() < 3 * sizeof(DWORD)) return false;
+    const DWORD* header = (const DWORD*)input.data();
+    DWORD chunkSize = header[1], chunkCount = header[2];
+    size_t pos = (3 + (size_t)chunkCount) * sizeof(DWORD);
+    if (chunkSize == 0 || pos > input.size()) return false;
+
+    output.resize(originalSize);
+    for (DWORD i = 0; i < chunkCount; i++) {
+        DWORD packedSize = header[3 + i];
+        size_t outPos = (size_t)i * chunkSize;
+        if (outPos >= originalSize || pos + packedSize > input.size()) return false;
+        size_t len = (originalSize - outPos < chunkSize) ? originalSize - outPos : chunkSize;
+        if (packedSize == len) {
+            memcpy(output.data() + outPos, input.data() + pos, len);
+        } else {
+            SIZE_T decompressedSize = 0;
+            if (!Decompress(g_decompressor, input.data() + pos, packedSize, output.data() + outPos, len, &decompressedSize)) return false;
+        }
+        pos += packedSize;
+    }
+    return true;
+}
+
+bool DecompressEntry(const std::vector<char>& input, std::vector<char>& output, size_t originalSize) {
+    if (g_decompressor == NULL) {
+        if (!CreateDecompressor(COMPRESS_ALGORITHM_LZMS, NULL, &g_decompressor)) return false;
+    }
+    if (input.size() >= sizeof(DWORD) && *(const DWORD*)input.data() == kChunkedMagic) {
+        return DecompressChunked(input, output, originalSize);
+    }
+    return DecompressLZMS(input, output, originalSize);
+}
+
 void DrawProgressBar(int current, int total, const std::wstring& currentFile) {
     const int barWidth = 30;
     float progress = (total > 0) ? (float)current / total : 1.0f;
@@ -76,6 +113,13 @@ bool UnpackFile(const fs::path& packagePath) {
 
     int fileCount = 0;
     fread(&fileCount, sizeof(int), 1, fpPack);
+    if ((DWORD)fileCount == kEncryptedMagic) {
+        SetColor(12);
+        std::wcout << L"\n[错误] 封包已加密，无法解包: " << packagePath.filename().wstring() << L"\n";
+        SetColor(7);
+        fclose(fpPack);
+        return false;
+    }
     if (fileCount <= 0 || fileCount > 2000000) {
         std::wcout << L"无效的封包格式或文件已损坏。\n";
         fclose(fpPack);
@@ -119,7 +163,7 @@ bool UnpackFile(const fs::path& packagePath) {
             if (finalSize > 0) fread(fileData.data(), 1, finalSize, fpPack);
 
             if (finalSize < originalSize && finalSize > 0) {
-                if (!DecompressLZMS(fileData, outData, originalSize)) {
+                if (!DecompressEntry(fileData, outData, originalSize)) {
                     outData = fileData;
                 }
             }